@@ -0,0 +1,131 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Execute batches of commands (many small actions per control transfer)
+#
+# Usage: python blinky_batch.py [--count N]
+#
+# Toggles the LED N times, first with a single LED control request per
+# action, then with command batches, and compares the action rates.
+#
+
+import argparse
+import struct
+import time
+import usb.core
+
+LED_CONTROL_ID = 0x33
+BATCH_ID = 0x38
+
+CMD_SET_PIN = 0x01
+CMD_READ_PIN = 0x02
+CMD_DELAY = 0x03
+CMD_SET_BRIGHTNESS = 0x04
+
+PIN_LED = 0
+MAX_BATCH_SIZE = 256
+MAX_DELAY = 500  # ms
+
+STATUS_OK = 0
+STATUS_PENDING = 4
+STATUS_TEXT = ['OK', 'invalid pin', 'invalid value', 'total delay too long', 'pending']
+
+
+class BatchError(Exception):
+    pass
+
+
+class Batch:
+    """Batch of commands executed by the device with a single control transfer"""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.num_reads = 0
+
+    def _add(self, command):
+        if len(self.data) + len(command) > MAX_BATCH_SIZE:
+            raise ValueError('Batch exceeds %d bytes' % MAX_BATCH_SIZE)
+        self.data += command
+
+    def set_pin(self, pin, value):
+        self._add(struct.pack('<BBB', CMD_SET_PIN, pin, 1 if value else 0))
+
+    def read_pin(self, pin):
+        self._add(struct.pack('<BB', CMD_READ_PIN, pin))
+        self.num_reads += 1
+
+    def delay(self, ms):
+        self._add(struct.pack('<BH', CMD_DELAY, ms))
+
+    def set_brightness(self, duty):
+        self._add(struct.pack('<BH', CMD_SET_BRIGHTNESS, duty))
+
+    def execute(self, dev):
+        """Executes the batch and returns the values read.
+
+        The device executes the batch outside of the USB interrupt handler.
+        So the result is requested until the batch is no longer pending.
+        The next batch is only accepted once the previous one is complete.
+        """
+        dev.ctrl_transfer(bmRequestType=0x41, bRequest=BATCH_ID, wValue=0, wIndex=0, data_or_wLength=self.data)
+        while True:
+            result = dev.ctrl_transfer(bmRequestType=0xc1, bRequest=BATCH_ID, wValue=0, wIndex=0,
+                                       data_or_wLength=2 + self.num_reads)
+            if result[0] != STATUS_PENDING:
+                break
+        status, num_executed = result[0], result[1]
+        if status != STATUS_OK:
+            raise BatchError('Command %d failed: %s' % (num_executed, STATUS_TEXT[status]))
+        return list(result[2:])
+
+
+def toggle_single(dev, count):
+    """Toggles the LED with a request per action. Returns the duration (in s)."""
+    start = time.perf_counter()
+    for i in range(count):
+        dev.ctrl_transfer(bmRequestType=0x41, bRequest=LED_CONTROL_ID, wValue=i & 1, wIndex=0)
+    return time.perf_counter() - start
+
+
+def toggle_batched(dev, count):
+    """Toggles the LED with command batches. Returns the duration (in s)."""
+    per_batch = MAX_BATCH_SIZE // 3
+    start = time.perf_counter()
+    for offset in range(0, count, per_batch):
+        batch = Batch()
+        for i in range(offset, min(offset + per_batch, count)):
+            batch.set_pin(PIN_LED, i & 1)
+        batch.execute(dev)
+    return time.perf_counter() - start
+
+
+parser = argparse.ArgumentParser(description='Execute command batches')
+parser.add_argument('--count', type=int, default=1000, help='number of LED actions')
+args = parser.parse_args()
+
+# find device
+dev = usb.core.find(idVendor=0xcafe, idProduct=0xcafe)
+if dev is None:
+    raise ValueError('Device not found')
+
+# set configuration
+dev.set_configuration()
+
+# mixed batch: blink and read back the LED pin
+batch = Batch()
+batch.set_pin(PIN_LED, 0)
+batch.read_pin(PIN_LED)
+batch.delay(200)
+batch.set_pin(PIN_LED, 1)
+batch.read_pin(PIN_LED)
+print("LED pin values:", batch.execute(dev))
+
+# compare action rates
+duration = toggle_single(dev, args.count)
+print("Single requests: %8.0f actions/s" % (args.count / duration))
+duration = toggle_batched(dev, args.count)
+print("Batches:         %8.0f actions/s" % (args.count / duration))
@@ -0,0 +1,190 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Control transfer benchmark (latency and rate of vendor requests)
+#
+# Usage: python blinky_bench.py [--request led|noop] [--mode sync|async] [--count N] [--in-flight N] [--simulate]
+#
+# Synchronous requests are issued with PyUSB (like blinky.py), one after
+# the other. Asynchronous requests are issued with python-libusb1
+# (pip install libusb1) with several requests in flight. As the host
+# processes the requests of the default control pipe one after the other,
+# this measures the achievable rate rather than the latency.
+#
+# With --simulate, a simulated device with a configurable service time
+# is used instead of the real device.
+#
+
+import argparse
+import heapq
+import math
+import random
+import time
+
+VENDOR_ID = 0xcafe
+PRODUCT_ID = 0xcafe
+
+REQUEST_TYPE = 0x41  # host to device, vendor, interface
+LED_CONTROL_ID = 0x33
+NOOP_ID = 0x34
+
+
+class SimulatedDevice:
+    """Simulated device: each control transfer takes a random service time (normal distribution)"""
+
+    def __init__(self, latency, jitter, seed=0):
+        self.latency = latency
+        self.jitter = jitter
+        self._random = random.Random(seed)
+
+    def service_time(self):
+        return max(self._random.gauss(self.latency, self.jitter), 0)
+
+    def ctrl_transfer(self, bmRequestType, bRequest, wValue=0, wIndex=0, data_or_wLength=None, timeout=None):
+        time.sleep(self.service_time())
+
+
+def percentile(sorted_values, p):
+    """Returns the p-th percentile (0 to 100) of the sorted values (nearest rank)"""
+    rank = max(math.ceil(p / 100 * len(sorted_values)), 1)
+    return sorted_values[rank - 1]
+
+
+def run_sync(dev, request, count):
+    """Issues the requests one after the other. Returns the latencies (in s)."""
+    latencies = []
+    for i in range(count):
+        start = time.perf_counter()
+        dev.ctrl_transfer(REQUEST_TYPE, request, i & 1, 0)
+        latencies.append(time.perf_counter() - start)
+    return latencies
+
+
+def run_async(handle, context, request, count, in_flight):
+    """Issues the requests with up to `in_flight` requests pending. Returns the latencies (in s)."""
+    import usb1
+    latencies = []
+    start_times = {}
+    state = {'submitted': 0, 'pending': 0, 'error': None}
+
+    def submit(transfer):
+        i = state['submitted']
+        state['submitted'] = i + 1
+        state['pending'] += 1
+        transfer.setControl(REQUEST_TYPE, request, i & 1, 0, b'', callback=completed, timeout=1000)
+        start_times[id(transfer)] = time.perf_counter()
+        transfer.submit()
+
+    def completed(transfer):
+        # exceptions must not be raised in the callback: record the failure and stop submitting
+        state['pending'] -= 1
+        status = transfer.getStatus()
+        if status != usb1.TRANSFER_COMPLETED:
+            if state['error'] is None:
+                state['error'] = 'Control transfer failed (status %d)' % status
+            return
+        latencies.append(time.perf_counter() - start_times[id(transfer)])
+        if state['error'] is None and state['submitted'] < count:
+            submit(transfer)
+
+    transfers = [handle.getTransfer() for _ in range(min(in_flight, count))]
+    for transfer in transfers:
+        submit(transfer)
+    # wait until all transfers have completed (or failed)
+    while state['pending'] > 0:
+        context.handleEvents()
+    if state['error'] is not None:
+        raise IOError(state['error'])
+    return latencies
+
+
+def run_async_simulated(sim, count, in_flight):
+    """Simulates asynchronous requests (processed one after the other by the device). Returns the latencies (in s)."""
+    latencies = []
+    completions = []  # heap of (completion time, submit time)
+    last_completion = time.perf_counter()
+    submitted = 0
+
+    def submit(now):
+        nonlocal last_completion, submitted
+        last_completion = max(now, last_completion) + sim.service_time()
+        heapq.heappush(completions, (last_completion, now))
+        submitted += 1
+
+    now = time.perf_counter()
+    while submitted < min(in_flight, count):
+        submit(now)
+    while completions:
+        completion, submit_time = heapq.heappop(completions)
+        delay = completion - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        now = time.perf_counter()
+        latencies.append(now - submit_time)
+        if submitted < count:
+            submit(now)
+    return latencies
+
+
+def report(latencies, elapsed):
+    values = sorted(latencies)
+    mean = sum(values) / len(values)
+    std_dev = math.sqrt(sum((v - mean) ** 2 for v in values) / len(values))
+    print("%d requests in %0.3f s: %0.1f requests/s" % (len(values), elapsed, len(values) / elapsed))
+    print("latency (ms): min %0.3f, p50 %0.3f, p90 %0.3f, p99 %0.3f, p99.9 %0.3f, max %0.3f"
+          % tuple(v * 1000 for v in (values[0], percentile(values, 50), percentile(values, 90),
+                                     percentile(values, 99), percentile(values, 99.9), values[-1])))
+    print("jitter (standard deviation): %0.3f ms" % (std_dev * 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the control transfers of the blinky device')
+    parser.add_argument('--request', choices=['led', 'noop'], default='led', help='vendor request to issue')
+    parser.add_argument('--mode', choices=['sync', 'async'], default='sync', help='synchronous or asynchronous')
+    parser.add_argument('--count', type=int, default=2000, help='number of requests')
+    parser.add_argument('--in-flight', type=int, default=4, help='pending requests (async mode)')
+    parser.add_argument('--simulate', action='store_true', help='use simulated device')
+    parser.add_argument('--sim-latency', type=float, default=1.0, help='service time of simulated device (in ms)')
+    parser.add_argument('--sim-jitter', type=float, default=0.1, help='jitter of simulated device (in ms)')
+    args = parser.parse_args()
+
+    request = LED_CONTROL_ID if args.request == 'led' else NOOP_ID
+    print("%s request, %s, %s device" % (args.request, args.mode, 'simulated' if args.simulate else 'real'))
+
+    if args.simulate:
+        sim = SimulatedDevice(args.sim_latency / 1000, args.sim_jitter / 1000)
+        start = time.perf_counter()
+        if args.mode == 'sync':
+            latencies = run_sync(sim, request, args.count)
+        else:
+            latencies = run_async_simulated(sim, args.count, args.in_flight)
+
+    elif args.mode == 'sync':
+        import usb.core
+        dev = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+        if dev is None:
+            raise ValueError('Device not found')
+        dev.set_configuration()
+        start = time.perf_counter()
+        latencies = run_sync(dev, request, args.count)
+
+    else:
+        import usb1
+        with usb1.USBContext() as context:
+            handle = context.openByVendorIDAndProductID(VENDOR_ID, PRODUCT_ID, skip_on_error=True)
+            if handle is None:
+                raise ValueError('Device not found')
+            handle.setConfiguration(1)
+            with handle.claimInterface(0):
+                start = time.perf_counter()
+                latencies = run_async(handle, context, request, args.count, args.in_flight)
+
+    report(latencies, time.perf_counter() - start)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,63 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Fade PWM LED (on PB6) with a fade executed by the device (from host)
+#
+# The duty cycle table is uploaded in a single control transfer.
+# The device's DMA controller feeds it to the PWM timer.
+#
+
+import math
+import struct
+import usb.core
+
+BRIGHTNESS_ID = 0x36
+FADE_ID = 0x37
+FADE_ONE_SHOT = 0
+FADE_LOOP = 1
+MAX_DUTY = 1000
+MAX_STEPS = 120
+MAX_INTERVAL = 6000  # ms
+
+STEPS = 100
+INTERVAL = 20  # ms
+
+
+def breathing_fade(num_steps):
+    """Creates a fade table for a breathing LED (gamma corrected sine wave)"""
+    return [round(MAX_DUTY * ((1 - math.cos(2 * math.pi * i / num_steps)) / 2) ** 2.2) for i in range(num_steps)]
+
+
+def pack_fade(interval, duties):
+    """Packs the time per step (in ms) and the duty cycles for the data stage"""
+    if not 1 <= len(duties) <= MAX_STEPS:
+        raise ValueError('Fade must have 1 to %d steps' % MAX_STEPS)
+    if not 1 <= interval <= MAX_INTERVAL:
+        raise ValueError('Time per step must be between 1 and %d ms' % MAX_INTERVAL)
+    if any(not 0 <= duty <= MAX_DUTY for duty in duties):
+        raise ValueError('Duty cycles must be between 0 and %d' % MAX_DUTY)
+    return struct.pack('<%dH' % (len(duties) + 1), interval, *duties)
+
+
+# find device
+dev = usb.core.find(idVendor=0xcafe, idProduct=0xcafe)
+if dev is None:
+    raise ValueError('Device not found')
+
+# set configuration
+dev.set_configuration()
+
+# set half brightness and read it back
+dev.ctrl_transfer(bmRequestType=0x41, bRequest=BRIGHTNESS_ID, wValue=MAX_DUTY // 2, wIndex=0)
+duty = struct.unpack('<H', dev.ctrl_transfer(bmRequestType=0xc1, bRequest=BRIGHTNESS_ID, wValue=0, wIndex=0,
+                                             data_or_wLength=2))[0]
+print("Brightness: %.1f%%" % (duty / 10))
+
+# upload and start fade
+dev.ctrl_transfer(bmRequestType=0x41, bRequest=FADE_ID, wValue=FADE_LOOP, wIndex=0,
+                  data_or_wLength=pack_fade(INTERVAL, breathing_fade(STEPS)))
+print("Fade running")
@@ -0,0 +1,53 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Blink LED with a pattern executed by the device (from host)
+#
+# The entire pattern is uploaded in a single control transfer.
+# The device executes it with a timer, independent of the host.
+#
+
+import struct
+import usb.core
+
+PATTERN_ID = 0x35
+PATTERN_ONE_SHOT = 0
+PATTERN_LOOP = 1
+MAX_STEPS = 48
+MIN_DURATION = 10  # µs
+
+# heartbeat: (LED state, duration in µs)
+PATTERN = [
+    (1, 100000),
+    (0, 150000),
+    (1, 100000),
+    (0, 650000),
+]
+
+
+def pack_pattern(steps):
+    """Packs the steps (pairs of state and duration in µs) for the data stage"""
+    if not 1 <= len(steps) <= MAX_STEPS:
+        raise ValueError('Pattern must have 1 to %d steps' % MAX_STEPS)
+    if any(duration < MIN_DURATION for _, duration in steps):
+        raise ValueError('Steps must be at least %d µs long' % MIN_DURATION)
+    return b''.join(struct.pack('<BI', state, duration) for state, duration in steps)
+
+
+# find device
+dev = usb.core.find(idVendor=0xcafe, idProduct=0xcafe)
+if dev is None:
+    raise ValueError('Device not found')
+
+# set configuration
+dev.set_configuration()
+
+# upload and start pattern
+dev.ctrl_transfer(bmRequestType=0x41, bRequest=PATTERN_ID, wValue=PATTERN_LOOP, wIndex=0,
+                  data_or_wLength=pack_pattern(PATTERN))
+running = dev.ctrl_transfer(bmRequestType=0xc1, bRequest=PATTERN_ID, wValue=0, wIndex=0, data_or_wLength=1)[0]
+print("Pattern running" if running else "Pattern not running")
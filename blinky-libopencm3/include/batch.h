@@ -0,0 +1,87 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Command batches (many small actions in a single vendor request)
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+// Commands (tag byte followed by the arguments, little endian)
+#define BATCH_CMD_SET_PIN 0x01        // pin (1 byte), value (1 byte: 0 or 1)
+#define BATCH_CMD_READ_PIN 0x02       // pin (1 byte); adds 1 byte (0 or 1) to the result
+#define BATCH_CMD_DELAY 0x03          // delay (2 bytes, in ms)
+#define BATCH_CMD_SET_BRIGHTNESS 0x04 // duty cycle (2 bytes, 0 to `PWM_MAX_DUTY`)
+
+// Pins (0: LED on PC13, 1 and 2: outputs on PB12 and PB13, 3 and 4: inputs with pull-up on PB14 and PB15)
+#define BATCH_NUM_PINS 5
+
+// Maximum total delay of a batch (in ms)
+#define BATCH_MAX_DELAY 500
+
+// Maximum length of a batch (in bytes)
+#define BATCH_MAX_LEN 256
+
+// Status of a batch
+enum batch_status : uint8_t
+{
+    BATCH_OK = 0,            // all commands have been executed
+    BATCH_ERR_PIN = 1,       // invalid pin (or input pin for set pin command)
+    BATCH_ERR_VALUE = 2,     // invalid value
+    BATCH_ERR_DELAY = 3,     // total delay exceeds `BATCH_MAX_DELAY`
+    BATCH_PENDING = 4,       // the batch has not been executed yet
+};
+
+// Result of a batch
+struct batch_result
+{
+    batch_status status;  // status
+    uint8_t num_executed; // number of successfully executed commands
+    uint8_t num_values;   // number of values read
+    uint8_t values[128];  // values read (in order of the read commands)
+};
+
+// Initializes the pins used by batches
+void batch_init();
+
+/**
+ * @brief Submits a batch of commands for execution.
+ *
+ * The commands are copied and executed later by `batch_run()`.
+ * Until then, the result status is `BATCH_PENDING`.
+ *
+ * @param data commands
+ * @param len length of commands (in bytes)
+ * @return `true` if the batch has been accepted, `false` if it is malformed
+ *      (unknown command or missing arguments) or the previous batch is still pending
+ */
+bool batch_submit(const uint8_t *data, int len);
+
+/**
+ * @brief Executes the submitted batch (if any).
+ *
+ * The commands are executed in order. Execution stops at the first
+ * failing command. The outcome is available with `batch_get_result()`.
+ *
+ * As delay commands busy-wait, this function must be called from the
+ * main loop and not from an interrupt handler.
+ */
+void batch_run();
+
+/**
+ * @brief Gets the result of the last batch.
+ *
+ * If the batch has not been executed yet, only the status
+ * (`BATCH_PENDING`) is valid.
+ *
+ * @return result
+ */
+const batch_result &batch_get_result();
+
+#endif
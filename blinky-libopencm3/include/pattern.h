@@ -0,0 +1,58 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * LED pattern engine (timed sequence of LED states)
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+// Maximum number of steps of a pattern (limited by the control buffer)
+#define PATTERN_MAX_STEPS 48
+
+// Minimum duration of a step (in µs)
+#define PATTERN_MIN_DURATION 10
+
+// Output state bit: LED pin (1: pin high, 0: pin low, as for the LED control request)
+#define PATTERN_STATE_LED 0x01
+
+// Step of a pattern
+struct pattern_step
+{
+    uint8_t state;     // output state (see `PATTERN_STATE_LED`)
+    uint32_t duration; // duration of the state (in µs)
+} __attribute__((packed));
+
+// Initializes the pattern engine (timer)
+void pattern_init();
+
+/**
+ * @brief Starts a pattern (replacing a running pattern).
+ *
+ * The steps are executed by a timer interrupt. A one-shot pattern
+ * stops after the last step and keeps its state.
+ *
+ * @param steps array of steps
+ * @param num_steps number of steps (1 to `PATTERN_MAX_STEPS`)
+ * @param loop `true` to repeat the pattern, `false` to run it once
+ * @return `true` if successful, `false` if the pattern is invalid
+ */
+bool pattern_start(const pattern_step *steps, int num_steps, bool loop);
+
+/// Stops the running pattern (the LED keeps its current state)
+void pattern_stop();
+
+/**
+ * @brief Indicates if a pattern is running.
+ *
+ * @return `true` if a pattern is running
+ */
+bool pattern_is_running();
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * PWM LED brightness and fades (on PB6)
+ */
+
+#ifndef PWM_H
+#define PWM_H
+
+#include <stdint.h>
+
+// Duty cycle for full brightness (duty cycle is in units of 0.1%)
+#define PWM_MAX_DUTY 1000
+
+// Maximum number of steps of a fade (limited by the control buffer)
+#define FADE_MAX_STEPS 120
+
+// Maximum time per fade step (in ms)
+#define FADE_MAX_INTERVAL 6000
+
+// Initializes PWM output (PB6, TIM4 channel 1) and the fade timer and DMA channel
+void pwm_init();
+
+/**
+ * @brief Sets the brightness (stopping a running fade).
+ *
+ * @param duty duty cycle (0 to `PWM_MAX_DUTY`)
+ * @return `true` if successful, `false` if the duty cycle is invalid
+ */
+bool pwm_set_duty(uint16_t duty);
+
+/**
+ * @brief Gets the current brightness.
+ *
+ * @return duty cycle (0 to `PWM_MAX_DUTY`)
+ */
+uint16_t pwm_get_duty();
+
+/**
+ * @brief Starts a fade (replacing a running fade).
+ *
+ * DMA copies the next duty cycle from the table to the PWM timer
+ * at the given interval, without any CPU involvement. A one-shot fade
+ * keeps the last duty cycle.
+ *
+ * @param duties table of duty cycles (0 to `PWM_MAX_DUTY`, 16 bit little endian each, no alignment required)
+ * @param num_steps number of duty cycles (1 to `FADE_MAX_STEPS`)
+ * @param interval time per step (in ms, 1 to `FADE_MAX_INTERVAL`)
+ * @param loop `true` to repeat the fade, `false` to run it once
+ * @return `true` if successful, `false` if the fade is invalid
+ */
+bool pwm_start_fade(const uint8_t *duties, int num_steps, uint16_t interval, bool loop);
+
+/// Stops the running fade (the brightness is kept)
+void pwm_stop_fade();
+
+#endif
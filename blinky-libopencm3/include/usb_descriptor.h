@@ -18,7 +18,18 @@
 // Interface index
 #define INTF_COMM 0
 
+// Vendor request for switching the LED on or off
 #define LED_CONTROL_ID 0x33
+// Vendor request doing nothing (for measuring the control transfer overhead)
+#define NOOP_ID 0x34
+// Vendor request for uploading and starting an LED pattern
+#define PATTERN_ID 0x35
+// Vendor request for setting the PWM LED brightness
+#define BRIGHTNESS_ID 0x36
+// Vendor request for uploading and starting a PWM fade
+#define FADE_ID 0x37
+// Vendor request for executing a batch of commands (and reading its result)
+#define BATCH_ID 0x38
 
 // USB descriptor string table
 extern const char *const usb_desc_strings[4];
@@ -27,6 +38,11 @@ extern const struct usb_device_descriptor usb_device_desc;
 // USB device configurations
 extern const struct usb_config_descriptor usb_config_descs[];
 
-void usb_init_serial_num();
+// Initializes the serial number and builds the string descriptor table
+void usb_init_string_descs();
+
+// Returns the precomputed string descriptor with the given index
+// (or nullptr if it is not available)
+const uint8_t *usb_get_string_desc(int index);
 
 #endif
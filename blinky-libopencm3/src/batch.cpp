@@ -0,0 +1,188 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Command batches (many small actions in a single vendor request)
+ *
+ * The commands are dispatched with a table indexed by the command tag.
+ * It is fixed at compile time and also provides the argument length,
+ * so malformed batches can be rejected before anything is executed.
+ *
+ * Batches are submitted from the USB interrupt handler but executed
+ * from the main loop so delays do not block USB communication.
+ */
+
+#include "batch.h"
+#include "common.h"
+#include "pattern.h"
+#include "pwm.h"
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <string.h>
+
+// Command handler
+typedef batch_status (*batch_handler)(const uint8_t *args);
+
+// Entry of the command table
+struct batch_command
+{
+    uint8_t arg_len;       // length of arguments (in bytes)
+    batch_handler handler; // handler (`nullptr` for invalid tags)
+};
+
+// Pin
+struct batch_pin
+{
+    uint32_t port;
+    uint16_t gpio;
+    bool is_output;
+};
+
+static const batch_pin pins[BATCH_NUM_PINS] = {
+    {GPIOC, GPIO13, true},
+    {GPIOB, GPIO12, true},
+    {GPIOB, GPIO13, true},
+    {GPIOB, GPIO14, false},
+    {GPIOB, GPIO15, false},
+};
+
+static batch_result result;
+static uint32_t total_delay;
+
+// submitted batch
+static uint8_t batch_data[BATCH_MAX_LEN];
+static int batch_len;
+static volatile bool is_pending;
+
+static batch_status set_pin(const uint8_t *args)
+{
+    if (args[0] >= BATCH_NUM_PINS || !pins[args[0]].is_output)
+        return BATCH_ERR_PIN;
+    if (args[1] > 1)
+        return BATCH_ERR_VALUE;
+
+    // the LED pin is also used by the pattern engine
+    if (args[0] == 0)
+        pattern_stop();
+
+    const batch_pin &pin = pins[args[0]];
+    if (args[1] != 0)
+        gpio_set(pin.port, pin.gpio);
+    else
+        gpio_clear(pin.port, pin.gpio);
+    return BATCH_OK;
+}
+
+static batch_status read_pin(const uint8_t *args)
+{
+    if (args[0] >= BATCH_NUM_PINS)
+        return BATCH_ERR_PIN;
+
+    const batch_pin &pin = pins[args[0]];
+    result.values[result.num_values] = gpio_get(pin.port, pin.gpio) != 0 ? 1 : 0;
+    result.num_values++;
+    return BATCH_OK;
+}
+
+static batch_status delay_ms(const uint8_t *args)
+{
+    uint32_t ms = args[0] | (args[1] << 8);
+    if (total_delay + ms > BATCH_MAX_DELAY)
+        return BATCH_ERR_DELAY;
+
+    total_delay += ms;
+    delay(ms);
+    return BATCH_OK;
+}
+
+static batch_status set_brightness(const uint8_t *args)
+{
+    return pwm_set_duty(args[0] | (args[1] << 8)) ? BATCH_OK : BATCH_ERR_VALUE;
+}
+
+// Command table (indexed by tag)
+static constexpr batch_command commands[] = {
+    {0, nullptr},        // 0x00: invalid
+    {2, set_pin},        // BATCH_CMD_SET_PIN
+    {1, read_pin},       // BATCH_CMD_READ_PIN
+    {2, delay_ms},       // BATCH_CMD_DELAY
+    {2, set_brightness}, // BATCH_CMD_SET_BRIGHTNESS
+};
+
+static constexpr int NUM_COMMANDS = sizeof(commands) / sizeof(commands[0]);
+
+static_assert(commands[BATCH_CMD_SET_PIN].handler == set_pin, "command table does not match tags");
+static_assert(commands[BATCH_CMD_READ_PIN].handler == read_pin, "command table does not match tags");
+static_assert(commands[BATCH_CMD_DELAY].handler == delay_ms, "command table does not match tags");
+static_assert(commands[BATCH_CMD_SET_BRIGHTNESS].handler == set_brightness, "command table does not match tags");
+
+// Each read command is at least 2 bytes long (tag and pin)
+static_assert(sizeof(result.values) >= 256 / 2, "result buffer too small for read commands");
+
+void batch_init()
+{
+    rcc_periph_clock_enable(RCC_GPIOB);
+    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, GPIO12 | GPIO13);
+    gpio_set_mode(GPIOB, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, GPIO14 | GPIO15);
+    gpio_set(GPIOB, GPIO14 | GPIO15); // pull-up
+}
+
+bool batch_submit(const uint8_t *data, int len)
+{
+    if (is_pending || len > BATCH_MAX_LEN)
+        return false;
+
+    // check that all commands are known and complete
+    int i = 0;
+    while (i < len)
+    {
+        uint8_t tag = data[i];
+        if (tag >= NUM_COMMANDS || commands[tag].handler == nullptr)
+            return false;
+        i += 1 + commands[tag].arg_len;
+    }
+    if (i != len)
+        return false;
+
+    memcpy(batch_data, data, len);
+    batch_len = len;
+    result.status = BATCH_PENDING;
+    result.num_executed = 0;
+    result.num_values = 0;
+    is_pending = true;
+    return true;
+}
+
+void batch_run()
+{
+    if (!is_pending)
+        return;
+
+    total_delay = 0;
+    batch_status status = BATCH_OK;
+
+    // execute commands in order
+    int i = 0;
+    while (i < batch_len)
+    {
+        const batch_command &command = commands[batch_data[i]];
+        status = command.handler(batch_data + i + 1);
+        if (status != BATCH_OK)
+            break;
+        result.num_executed++;
+        i += 1 + command.arg_len;
+    }
+
+    // complete the result before the USB interrupt handler can see it
+    __asm__ volatile("" ::: "memory");
+    result.status = status;
+    is_pending = false;
+}
+
+const batch_result &batch_get_result()
+{
+    return result;
+}
@@ -8,12 +8,16 @@
  * Main program
  */
 
+#include "batch.h"
 #include "common.h"
+#include "pattern.h"
+#include "pwm.h"
 #include "usb_descriptor.h"
 #include "wcid.h"
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/usb/usbd.h>
+#include <algorithm>
 
 static void usb_set_config(usbd_device *usbd_dev, uint16_t wValue);
 static usbd_request_return_codes led_control(usbd_device *usbd_dev, usb_setup_data *req,
@@ -39,6 +43,15 @@ void init()
 
     // Initialize systick services
     systick_init();
+
+    // Initialize pattern engine
+    pattern_init();
+
+    // Initialize PWM LED
+    pwm_init();
+
+    // Initialize pins for command batches
+    batch_init();
 }
 
 void usb_init()
@@ -54,7 +67,7 @@ void usb_init()
     gpio_clear(GPIOA, GPIO12);
     delay(80);
 
-    usb_init_serial_num();
+    usb_init_string_descs();
 
     // create USB device
     usb_device = usbd_init(&st_usbfs_v1_usb_driver, &usb_device_desc, usb_config_descs,
@@ -92,6 +105,8 @@ usbd_request_return_codes led_control(__attribute__((unused)) usbd_device *usbd_
     // wIndex: 0 (interface number)
     if (req->bRequest == LED_CONTROL_ID && req->wIndex == 0)
     {
+        pattern_stop();
+
         if (req->wValue == 0)
             gpio_clear(GPIOC, GPIO13);
         else
@@ -104,6 +119,125 @@ usbd_request_return_codes led_control(__attribute__((unused)) usbd_device *usbd_
         return USBD_REQ_HANDLED;
     }
 
+    // No-op request (same format, but without any effect):
+    // bmRequestType = 0x41 (data direction: host to device, type: vendor, recipient: interface)
+    // bmRequest: 0x34 (no-op request)
+    // wValue: ignored
+    // wIndex: 0 (interface number)
+    if (req->bRequest == NOOP_ID && req->wIndex == 0)
+    {
+        *buf = nullptr;
+        *len = 0;
+        return USBD_REQ_HANDLED;
+    }
+
+    // Pattern request:
+    // bmRequestType = 0x41 to start a pattern (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to check if a pattern is running (data direction: device to host, 1 byte)
+    // bmRequest: 0x35 (pattern request)
+    // wValue: 0 for one-shot, 1 for loop
+    // wIndex: 0 (interface number)
+    // data: steps (see `pattern_step`, little endian); no data to stop the running pattern
+    if (req->bRequest == PATTERN_ID && req->wIndex == 0)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            (*buf)[0] = pattern_is_running() ? 1 : 0;
+            *len = std::min(*len, (uint16_t)1);
+            return USBD_REQ_HANDLED;
+        }
+
+        if (*len == 0)
+        {
+            pattern_stop();
+            return USBD_REQ_HANDLED;
+        }
+
+        if (*len % sizeof(pattern_step) != 0)
+            return USBD_REQ_NOTSUPP;
+
+        bool ok = pattern_start(reinterpret_cast<const pattern_step *>(*buf), *len / sizeof(pattern_step),
+                                req->wValue != 0);
+        *len = 0;
+        return ok ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Brightness request:
+    // bmRequestType = 0x41 to set the brightness (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the brightness (data direction: device to host, 2 bytes, little endian)
+    // bmRequest: 0x36 (brightness request)
+    // wValue: duty cycle (0 to 1000, i.e. in units of 0.1%)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == BRIGHTNESS_ID && req->wIndex == 0)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            uint16_t duty = pwm_get_duty();
+            (*buf)[0] = duty & 0xff;
+            (*buf)[1] = duty >> 8;
+            *len = std::min(*len, (uint16_t)2);
+            return USBD_REQ_HANDLED;
+        }
+
+        *len = 0;
+        return pwm_set_duty(req->wValue) ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Fade request:
+    // bmRequestType = 0x41 (data direction: host to device, type: vendor, recipient: interface)
+    // bmRequest: 0x37 (fade request)
+    // wValue: 0 for one-shot, 1 for loop
+    // wIndex: 0 (interface number)
+    // data: time per step (in ms, 16 bit) followed by duty cycles (16 bit each), little endian;
+    //       no data to stop the running fade
+    if (req->bRequest == FADE_ID && req->wIndex == 0)
+    {
+        if (*len == 0)
+        {
+            pwm_stop_fade();
+            return USBD_REQ_HANDLED;
+        }
+
+        if (*len < 4 || *len % 2 != 0)
+            return USBD_REQ_NOTSUPP;
+
+        // the data is not necessarily aligned: access it byte by byte
+        uint16_t interval = (*buf)[0] | ((*buf)[1] << 8);
+        bool ok = pwm_start_fade(*buf + 2, *len / 2 - 1, interval, req->wValue != 0);
+        *len = 0;
+        return ok ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Batch request:
+    // bmRequestType = 0x41 to execute a batch (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the result of the last batch (data direction: device to host)
+    // bmRequest: 0x38 (batch request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data (host to device): commands (see `BATCH_CMD_xxx`)
+    // data (device to host): status (see `batch_status`), number of executed commands, values read (1 byte each)
+    // The batch is executed by the main loop. Until it is complete, the status is `BATCH_PENDING`.
+    // A new batch is rejected while the previous one is pending.
+    if (req->bRequest == BATCH_ID && req->wIndex == 0)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            // the values are only valid once the batch has been executed
+            const batch_result &result = batch_get_result();
+            batch_status status = result.status;
+            int num_values = status != BATCH_PENDING ? result.num_values : 0;
+            (*buf)[0] = status;
+            (*buf)[1] = result.num_executed;
+            std::copy(result.values, result.values + num_values, *buf + 2);
+            *len = std::min(*len, (uint16_t)(2 + num_values));
+            return USBD_REQ_HANDLED;
+        }
+
+        bool ok = batch_submit(*buf, *len);
+        *len = 0;
+        return ok ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
     // pass on to next request handler
     return USBD_REQ_NEXT_CALLBACK;
 }
@@ -113,8 +247,9 @@ int main()
     init();
     usb_init();
 
+    // all other action is in interrupt handlers
     while (true)
-        ; // do nothing; all the action is in interrupt handlers
+        batch_run();
 }
 
 // USB interrupt handler
@@ -0,0 +1,141 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * LED pattern engine (timed sequence of LED states)
+ *
+ * TIM2 counts at 1 MHz. The period of each step is loaded into the
+ * auto-reload register (without preload so it applies to the running
+ * period). The update interrupt switches to the next step. Steps
+ * longer than the 16-bit counter range are split into several periods.
+ */
+
+#include "pattern.h"
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <string.h>
+
+// Maximum period of the 16-bit timer (in µs)
+static constexpr uint32_t MAX_PERIOD = 65536;
+
+static pattern_step steps[PATTERN_MAX_STEPS];
+static int num_steps;
+static bool is_loop;
+static volatile bool is_running;
+
+static int step_index;         // index of current step
+static uint32_t remaining_time; // remaining duration of current step after the running period (in µs)
+
+// Sets the outputs to the given state
+static void set_outputs(uint8_t state)
+{
+    if ((state & PATTERN_STATE_LED) != 0)
+        gpio_set(GPIOC, GPIO13);
+    else
+        gpio_clear(GPIOC, GPIO13);
+}
+
+// Loads the next period of the current step
+static void load_period()
+{
+    uint32_t period = remaining_time;
+    if (period > MAX_PERIOD)
+    {
+        // avoid a too short last period
+        period = remaining_time - MAX_PERIOD >= PATTERN_MIN_DURATION ? MAX_PERIOD : MAX_PERIOD / 2;
+    }
+    remaining_time -= period;
+    timer_set_period(TIM2, period - 1);
+}
+
+// Switches to the given step
+static void enter_step(int index)
+{
+    step_index = index;
+    set_outputs(steps[index].state);
+    remaining_time = steps[index].duration;
+    load_period();
+}
+
+void pattern_init()
+{
+    rcc_periph_clock_enable(RCC_TIM2);
+    rcc_periph_reset_pulse(RST_TIM2);
+
+    // 1 MHz counter clock (timer clock is twice the APB1 clock)
+    timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM2, rcc_apb1_frequency * 2 / 1000000 - 1);
+    timer_disable_preload(TIM2);
+
+    // load prescaler (the update interrupt is only triggered by overflows)
+    timer_update_on_overflow(TIM2);
+    timer_generate_event(TIM2, TIM_EGR_UG);
+    timer_enable_irq(TIM2, TIM_DIER_UIE);
+
+    // higher priority than USB so USB requests do not delay the steps
+    nvic_set_priority(NVIC_TIM2_IRQ, 1 << 6);
+    nvic_enable_irq(NVIC_TIM2_IRQ);
+}
+
+bool pattern_start(const pattern_step *new_steps, int n, bool loop)
+{
+    if (n < 1 || n > PATTERN_MAX_STEPS)
+        return false;
+    for (int i = 0; i < n; i++)
+    {
+        if (new_steps[i].duration < PATTERN_MIN_DURATION)
+            return false;
+    }
+
+    pattern_stop();
+    memcpy(steps, new_steps, n * sizeof(pattern_step));
+    num_steps = n;
+    is_loop = loop;
+
+    timer_set_counter(TIM2, 0);
+    enter_step(0);
+    is_running = true;
+    timer_enable_counter(TIM2);
+    return true;
+}
+
+void pattern_stop()
+{
+    timer_disable_counter(TIM2);
+    timer_clear_flag(TIM2, TIM_SR_UIF);
+    is_running = false;
+}
+
+bool pattern_is_running()
+{
+    return is_running;
+}
+
+// Timer interrupt handler (end of period)
+extern "C" void tim2_isr()
+{
+    timer_clear_flag(TIM2, TIM_SR_UIF);
+
+    if (remaining_time > 0)
+    {
+        load_period();
+        return;
+    }
+
+    int next = step_index + 1;
+    if (next >= num_steps)
+    {
+        if (!is_loop)
+        {
+            pattern_stop();
+            return;
+        }
+        next = 0;
+    }
+    enter_step(next);
+}
@@ -0,0 +1,125 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * PWM LED brightness and fades (on PB6)
+ *
+ * PC13 (on-board LED) is not connected to a timer. So PWM is output
+ * on PB6 (TIM4 channel 1) at 1 kHz. An LED with a series resistor
+ * must be connected to PB6.
+ *
+ * For fades, TIM3 generates an update event per step. Each update
+ * event triggers a DMA request (DMA1 channel 3) that copies the next
+ * duty cycle from the table to the compare register of TIM4. The
+ * compare register is preloaded so the duty cycle changes at the end
+ * of a PWM period without glitches. Looping fades use circular DMA;
+ * one-shot fades stop the step timer in the transfer complete interrupt.
+ */
+
+#include "pwm.h"
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <string.h>
+
+static uint16_t fade_table[FADE_MAX_STEPS];
+
+void pwm_init()
+{
+    rcc_periph_clock_enable(RCC_GPIOB);
+    rcc_periph_clock_enable(RCC_TIM3);
+    rcc_periph_clock_enable(RCC_TIM4);
+    rcc_periph_clock_enable(RCC_DMA1);
+
+    // PB6: TIM4 channel 1
+    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO6);
+
+    // TIM4: 1 MHz counter clock (timer clock is twice the APB1 clock), 1 kHz PWM
+    rcc_periph_reset_pulse(RST_TIM4);
+    timer_set_mode(TIM4, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM4, rcc_apb1_frequency * 2 / 1000000 - 1);
+    timer_set_period(TIM4, PWM_MAX_DUTY - 1);
+    timer_enable_preload(TIM4);
+    timer_set_oc_mode(TIM4, TIM_OC1, TIM_OCM_PWM1);
+    timer_enable_oc_preload(TIM4, TIM_OC1);
+    timer_set_oc_value(TIM4, TIM_OC1, 0);
+    timer_enable_oc_output(TIM4, TIM_OC1);
+    timer_enable_counter(TIM4);
+
+    // TIM3: fade step timer with 10 kHz counter clock, DMA request on update
+    rcc_periph_reset_pulse(RST_TIM3);
+    timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+    timer_set_prescaler(TIM3, rcc_apb1_frequency * 2 / 10000 - 1);
+    timer_enable_irq(TIM3, TIM_DIER_UDE);
+
+    nvic_set_priority(NVIC_DMA1_CHANNEL3_IRQ, 2 << 6);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL3_IRQ);
+}
+
+bool pwm_set_duty(uint16_t duty)
+{
+    if (duty > PWM_MAX_DUTY)
+        return false;
+
+    pwm_stop_fade();
+    timer_set_oc_value(TIM4, TIM_OC1, duty);
+    return true;
+}
+
+uint16_t pwm_get_duty()
+{
+    return TIM_CCR1(TIM4);
+}
+
+bool pwm_start_fade(const uint8_t *duties, int num_steps, uint16_t interval, bool loop)
+{
+    if (num_steps < 1 || num_steps > FADE_MAX_STEPS || interval < 1 || interval > FADE_MAX_INTERVAL)
+        return false;
+    for (int i = 0; i < num_steps; i++)
+    {
+        if ((duties[2 * i] | (duties[2 * i + 1] << 8)) > PWM_MAX_DUTY)
+            return false;
+    }
+
+    pwm_stop_fade();
+    memcpy(fade_table, duties, num_steps * sizeof(uint16_t));
+
+    dma_channel_reset(DMA1, DMA_CHANNEL3);
+    dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&TIM_CCR1(TIM4));
+    dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)fade_table);
+    dma_set_number_of_data(DMA1, DMA_CHANNEL3, num_steps);
+    dma_set_read_from_memory(DMA1, DMA_CHANNEL3);
+    dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
+    dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_16BIT);
+    dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_16BIT);
+    dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_MEDIUM);
+    if (loop)
+        dma_enable_circular_mode(DMA1, DMA_CHANNEL3);
+    else
+        dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
+    dma_enable_channel(DMA1, DMA_CHANNEL3);
+
+    // the update event generated by software copies the first step immediately
+    timer_set_period(TIM3, interval * 10 - 1);
+    timer_generate_event(TIM3, TIM_EGR_UG);
+    timer_enable_counter(TIM3);
+    return true;
+}
+
+void pwm_stop_fade()
+{
+    timer_disable_counter(TIM3);
+    dma_disable_channel(DMA1, DMA_CHANNEL3);
+}
+
+// DMA interrupt handler (one-shot fade is complete)
+extern "C" void dma1_channel3_isr()
+{
+    dma_clear_interrupt_flags(DMA1, DMA_CHANNEL3, DMA_TCIF);
+    pwm_stop_fade();
+}
@@ -10,6 +10,7 @@
 
 #include "usb_descriptor.h"
 #include <libopencm3/stm32/desig.h>
+#include <string.h>
 
 static void put_hex(uint32_t value, char *buf, int len);
 
@@ -91,7 +92,47 @@ const struct usb_device_descriptor usb_device_desc = {
     .bNumConfigurations = sizeof(usb_config_descs) / sizeof(usb_config_descs[0]),
 };
 
-void usb_init_serial_num()
+// String descriptors in UTF-16LE format (index 0: language ID),
+// built once at startup so they can be served without conversion
+static constexpr int NUM_STRINGS = sizeof(usb_desc_strings) / sizeof(usb_desc_strings[0]);
+static uint8_t string_desc_buf[160] __attribute__((aligned(2)));
+static const uint8_t *string_descs[1 + NUM_STRINGS];
+
+// Language ID descriptor: English (United States)
+static const uint8_t lang_id_desc[] = {4, USB_DT_STRING, 0x09, 0x04};
+
+static void init_string_table()
+{
+    string_descs[0] = lang_id_desc;
+
+    uint8_t *p = string_desc_buf;
+    for (int i = 0; i < NUM_STRINGS; i++)
+    {
+        const char *str = usb_desc_strings[i];
+        int len = strlen(str);
+        int desc_len = 2 + 2 * len;
+        if (desc_len > 255 || p + desc_len > string_desc_buf + sizeof(string_desc_buf))
+            break; // remaining strings are served by LibOpenCM3
+
+        string_descs[i + 1] = p;
+        *p++ = desc_len;
+        *p++ = USB_DT_STRING;
+        for (int j = 0; j < len; j++)
+        {
+            *p++ = str[j];
+            *p++ = 0;
+        }
+    }
+}
+
+const uint8_t *usb_get_string_desc(int index)
+{
+    if (index < 0 || index > NUM_STRINGS)
+        return nullptr;
+    return string_descs[index];
+}
+
+void usb_init_string_descs()
 {
     uint32_t id0 = DESIG_UNIQUE_ID0;
     uint32_t id1 = DESIG_UNIQUE_ID1;
@@ -102,6 +143,8 @@ void usb_init_serial_num()
     put_hex(id0, serial_num, 8);
     put_hex(id1, serial_num + 8, 4);
     serial_num[12] = 0;
+
+    init_string_table();
 }
 
 const static char HEX_DIGITS[] = "0123456789ABCDEF";
@@ -8,19 +8,21 @@
  * Microsoft WCID descriptors
  */
 
+#include "usb_descriptor.h"
 #include <libopencm3/usb/usbd.h>
 #include <algorithm>
 
-static usbd_request_return_codes msft_string_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
+static usbd_request_return_codes string_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
 static usbd_request_return_codes msft_feature_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
 
 // Registers additional control request handlers to implement
+// the WCID descriptors and serve the precomputed string descriptors
 // See https://github.com/pbatard/libwdi/wiki/WCID-Devices
 void register_wcid_desc(usbd_device *usb_dev)
 {
     usbd_register_control_callback(usb_dev,
                                    USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE, USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
-                                   msft_string_desc);
+                                   string_desc);
     usbd_register_control_callback(usb_dev,
                                    USB_REQ_TYPE_VENDOR, USB_REQ_TYPE_TYPE,
                                    msft_feature_desc);
@@ -52,7 +54,7 @@ static const uint8_t wcid_feature_desc[] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00              // reserved 6 bytes
 };
 
-usbd_request_return_codes msft_string_desc(__attribute__((unused)) usbd_device *usbd_dev, usb_setup_data *req,
+usbd_request_return_codes string_desc(__attribute__((unused)) usbd_device *usbd_dev, usb_setup_data *req,
                                            uint8_t **buf, uint16_t *len,
                                            __attribute__((unused)) usbd_control_complete_callback *complete)
 {
@@ -65,6 +67,19 @@ usbd_request_return_codes msft_string_desc(__attribute__((unused)) usbd_device *
         return USBD_REQ_HANDLED;
     }
 
+    // other string descriptors: serve precomputed UTF-16 descriptor
+    // instead of having LibOpenCM3 convert the string on each request
+    if (req->bRequest == USB_REQ_GET_DESCRIPTOR && (req->wValue >> 8) == USB_DT_STRING)
+    {
+        const uint8_t *desc = usb_get_string_desc(req->wValue & 0xff);
+        if (desc == nullptr)
+            return USBD_REQ_NEXT_CALLBACK;
+
+        *buf = const_cast<uint8_t *>(desc);
+        *len = std::min(*len, (uint16_t)desc[0]);
+        return USBD_REQ_HANDLED;
+    }
+
     return USBD_REQ_NEXT_CALLBACK;
 }
 
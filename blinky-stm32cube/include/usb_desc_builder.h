@@ -0,0 +1,445 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Compile-time builder for USB descriptors and packet memory layout
+ *
+ * All functions are constexpr. If the result is assigned to a constexpr
+ * variable, the descriptors are built by the compiler and end up in flash
+ * as plain byte arrays. Invalid values (e.g. a packet size not supported
+ * by a bulk endpoint or a packet memory overflow) result in a compile error
+ * mentioning the call to `usb_desc_error()`.
+ */
+
+#ifndef USB_DESC_BUILDER_H
+#define USB_DESC_BUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace usb_desc
+{
+
+/**
+ * Reports an invalid descriptor.
+ *
+ * Intentionally neither constexpr nor defined: calling it during
+ * constant evaluation results in a compile error.
+ */
+void usb_desc_error(const char *msg);
+
+/// Checks a condition and reports an error if it isn't met
+constexpr void check(bool condition, const char *msg)
+{
+    if (!condition)
+        usb_desc_error(msg);
+}
+
+/**
+ * Descriptor as a byte array.
+ *
+ * @param N descriptor length (in bytes)
+ */
+template <size_t N>
+struct bytes
+{
+    uint8_t data[N];
+
+    /// Returns the descriptor length
+    static constexpr uint16_t size() { return N; }
+
+    /// Returns the byte at the specified index
+    constexpr uint8_t operator[](size_t index) const { return data[index]; }
+};
+
+/// Concatenates two descriptors
+template <size_t A, size_t B>
+constexpr bytes<A + B> operator+(const bytes<A> &a, const bytes<B> &b)
+{
+    bytes<A + B> result{};
+    for (size_t i = 0; i < A; i++)
+        result.data[i] = a.data[i];
+    for (size_t i = 0; i < B; i++)
+        result.data[A + i] = b.data[i];
+    return result;
+}
+
+/// Concatenates a single descriptor (end of recursion)
+template <size_t A>
+constexpr bytes<A> concat(const bytes<A> &a)
+{
+    return a;
+}
+
+/// Concatenates several descriptors
+template <size_t A, size_t... Rest>
+constexpr auto concat(const bytes<A> &a, const bytes<Rest> &...rest)
+{
+    return a + concat(rest...);
+}
+
+constexpr uint8_t lo_byte(uint16_t value) { return value & 0xff; }
+constexpr uint8_t hi_byte(uint16_t value) { return value >> 8; }
+
+// Descriptor types
+constexpr uint8_t DESC_TYPE_DEVICE = 0x01;
+constexpr uint8_t DESC_TYPE_CONFIGURATION = 0x02;
+constexpr uint8_t DESC_TYPE_STRING = 0x03;
+constexpr uint8_t DESC_TYPE_INTERFACE = 0x04;
+constexpr uint8_t DESC_TYPE_ENDPOINT = 0x05;
+
+// Endpoint transfer types
+constexpr uint8_t EP_TYPE_CONTROL = 0x00;
+constexpr uint8_t EP_TYPE_ISOCHRONOUS = 0x01;
+constexpr uint8_t EP_TYPE_BULK = 0x02;
+constexpr uint8_t EP_TYPE_INTERRUPT = 0x03;
+
+/// Vendor-specific device/interface class
+constexpr uint8_t CLASS_VENDOR = 0xff;
+
+/// Returns if the value is a valid packet size for EP0 and bulk endpoints
+constexpr bool is_valid_full_speed_packet_size(uint16_t size)
+{
+    return size == 8 || size == 16 || size == 32 || size == 64;
+}
+
+/**
+ * Creates a device descriptor.
+ *
+ * @param bcd_usb USB version (BCD), e.g. 0x0200
+ * @param device_class device class
+ * @param ep0_size maximum packet size of control endpoint 0
+ * @param vid vendor ID
+ * @param pid product ID
+ * @param bcd_device device release (BCD)
+ * @param i_manufacturer manufacturer string index
+ * @param i_product product string index
+ * @param i_serial serial number string index
+ * @param num_configs number of configurations
+ */
+constexpr bytes<18> device(uint16_t bcd_usb, uint8_t device_class, uint8_t ep0_size,
+                           uint16_t vid, uint16_t pid, uint16_t bcd_device,
+                           uint8_t i_manufacturer, uint8_t i_product, uint8_t i_serial,
+                           uint8_t num_configs)
+{
+    check(is_valid_full_speed_packet_size(ep0_size), "EP0 packet size must be 8, 16, 32 or 64");
+    check(num_configs >= 1, "at least one configuration required");
+
+    return bytes<18>{{
+        18,                  // bLength
+        DESC_TYPE_DEVICE,    // bDescriptorType
+        lo_byte(bcd_usb),    // bcdUSB
+        hi_byte(bcd_usb),    //
+        device_class,        // bDeviceClass
+        0x00,                // bDeviceSubClass
+        0x00,                // bDeviceProtocol
+        ep0_size,            // bMaxPacketSize
+        lo_byte(vid),        // idVendor
+        hi_byte(vid),        //
+        lo_byte(pid),        // idProduct
+        hi_byte(pid),        //
+        lo_byte(bcd_device), // bcdDevice
+        hi_byte(bcd_device), //
+        i_manufacturer,      // iManufacturer
+        i_product,           // iProduct
+        i_serial,            // iSerialNumber
+        num_configs,         // bNumConfigurations
+    }};
+}
+
+/**
+ * Creates an endpoint descriptor.
+ *
+ * @param address endpoint address (bit 7 set for IN endpoints)
+ * @param type transfer type (`EP_TYPE_xxx`)
+ * @param max_packet_size maximum packet size
+ * @param interval polling interval (in ms)
+ */
+constexpr bytes<7> endpoint(uint8_t address, uint8_t type, uint16_t max_packet_size, uint8_t interval)
+{
+    check((address & 0x0f) != 0 && (address & 0x0f) < 8 && (address & 0x70) == 0,
+          "endpoint number must be between 1 and 7");
+    check(type != EP_TYPE_CONTROL, "only endpoint 0 can be a control endpoint");
+    check(type != EP_TYPE_BULK || is_valid_full_speed_packet_size(max_packet_size),
+          "bulk packet size must be 8, 16, 32 or 64");
+    check(type != EP_TYPE_INTERRUPT || (max_packet_size >= 1 && max_packet_size <= 64),
+          "interrupt packet size must be between 1 and 64");
+    check(type != EP_TYPE_ISOCHRONOUS || max_packet_size <= 1023,
+          "isochronous packet size must not exceed 1023");
+    check(type != EP_TYPE_INTERRUPT || interval >= 1, "interrupt endpoint requires interval");
+
+    return bytes<7>{{
+        7,                        // bLength
+        DESC_TYPE_ENDPOINT,       // bDescriptorType
+        address,                  // bEndpointAddress
+        type,                     // bmAttributes
+        lo_byte(max_packet_size), // wMaxPacketSize
+        hi_byte(max_packet_size), //
+        interval,                 // bInterval
+    }};
+}
+
+/**
+ * Creates an interface descriptor followed by its endpoint descriptors.
+ *
+ * The number of endpoints is derived from the endpoint descriptors.
+ *
+ * @param number interface number
+ * @param alternate alternate setting
+ * @param interface_class interface class
+ * @param i_interface interface string index
+ * @param endpoints endpoint descriptors
+ */
+template <size_t... E>
+constexpr auto interface(uint8_t number, uint8_t alternate, uint8_t interface_class, uint8_t i_interface,
+                         const bytes<E> &...endpoints)
+{
+    return concat(bytes<9>{{
+                      9,                         // bLength
+                      DESC_TYPE_INTERFACE,       // bDescriptorType
+                      number,                    // bInterfaceNumber
+                      alternate,                 // bAlternateSetting
+                      (uint8_t)sizeof...(E),     // bNumEndpoints
+                      interface_class,           // bInterfaceClass
+                      0x00,                      // bInterfaceSubClass
+                      0x00,                      // bInterfaceProtocol
+                      i_interface,               // iInterface
+                  }},
+                  endpoints...);
+}
+
+/**
+ * Creates a configuration descriptor including all interface and endpoint descriptors.
+ *
+ * The total length is derived from the descriptors.
+ *
+ * @param num_interfaces number of interfaces
+ * @param value configuration value
+ * @param i_configuration configuration string index
+ * @param max_power_ma maximum power consumption (in mA)
+ * @param interfaces interface descriptors (incl. endpoint descriptors)
+ */
+template <size_t I>
+constexpr auto configuration(uint8_t num_interfaces, uint8_t value, uint8_t i_configuration,
+                             uint16_t max_power_ma, const bytes<I> &interfaces)
+{
+    constexpr uint16_t total_length = 9 + I;
+    check(num_interfaces >= 1, "at least one interface required");
+    check(value >= 1, "configuration value 0 is reserved");
+    check(max_power_ma <= 500, "USB bus can provide at most 500 mA");
+
+    return bytes<9>{{
+               9,                       // bLength
+               DESC_TYPE_CONFIGURATION, // bDescriptorType
+               lo_byte(total_length),   // wTotalLength
+               hi_byte(total_length),   //
+               num_interfaces,          // bNumInterfaces
+               value,                   // bConfigurationValue
+               i_configuration,         // iConfiguration
+               0x80,                    // bmAttributes: bus powered
+               (uint8_t)(max_power_ma / 2), // bMaxPower (in 2 mA units)
+           }} +
+           interfaces;
+}
+
+/**
+ * Creates a string descriptor from an ASCII string literal.
+ *
+ * The conversion to UTF-16LE is done at compile time.
+ *
+ * @param str ASCII string
+ */
+template <size_t N>
+constexpr bytes<2 * N> string(const char (&str)[N])
+{
+    static_assert(2 * N <= 255, "string descriptor too long");
+
+    bytes<2 * N> result{};
+    result.data[0] = 2 * N; // N includes the terminating null, i.e. 2 + 2 * (N - 1)
+    result.data[1] = DESC_TYPE_STRING;
+    for (size_t i = 0; i < N - 1; i++)
+    {
+        check((uint8_t)str[i] < 0x80, "only ASCII characters are supported");
+        result.data[2 + 2 * i] = str[i];
+        result.data[3 + 2 * i] = 0;
+    }
+    return result;
+}
+
+/**
+ * Creates the string descriptor 0 with the supported language.
+ *
+ * @param lang_id language ID, e.g. 0x0409 for English (United States)
+ */
+constexpr bytes<4> lang_id(uint16_t lang_id)
+{
+    return bytes<4>{{4, DESC_TYPE_STRING, lo_byte(lang_id), hi_byte(lang_id)}};
+}
+
+/**
+ * Creates the Microsoft OS string descriptor (string index 0xee).
+ *
+ * See https://github.com/pbatard/libwdi/wiki/WCID-Devices
+ *
+ * @param vendor_code vendor code used for requesting the WCID feature descriptor
+ */
+constexpr bytes<18> msft_os_string(uint8_t vendor_code)
+{
+    bytes<18> result = string("MSFT100") + bytes<2>{{vendor_code, 0}};
+    result.data[0] = 18;
+    return result;
+}
+
+/**
+ * Creates a function section of the WCID feature descriptor.
+ *
+ * @param interface_number interface number
+ * @param compatible_id compatible ID, e.g. "WINUSB"
+ */
+template <size_t N>
+constexpr bytes<24> wcid_function(uint8_t interface_number, const char (&compatible_id)[N])
+{
+    static_assert(N <= 9, "compatible ID is limited to 8 characters");
+
+    bytes<24> result{};
+    result.data[0] = interface_number; // bFirstInterfaceNumber
+    result.data[1] = 0x01;             // reserved
+    for (size_t i = 0; i < N - 1; i++)
+        result.data[2 + i] = compatible_id[i];
+    // sub-compatible ID and reserved bytes remain 0
+    return result;
+}
+
+/**
+ * Creates the Microsoft WCID feature descriptor (index 0x0004).
+ *
+ * The length and the number of sections are derived from the function sections.
+ *
+ * @param functions function sections
+ */
+template <size_t... F>
+constexpr auto wcid_feature(const bytes<F> &...functions)
+{
+    constexpr uint16_t length = 16 + 24 * sizeof...(F);
+
+    return concat(bytes<16>{{
+                      lo_byte(length),         // dwLength
+                      hi_byte(length),         //
+                      0x00,                    //
+                      0x00,                    //
+                      0x00,                    // bcdVersion = 1.0
+                      0x01,                    //
+                      0x04,                    // wIndex = 0x0004 (compatibility ID)
+                      0x00,                    //
+                      (uint8_t)sizeof...(F),   // bCount
+                      0, 0, 0, 0, 0, 0, 0,     // reserved (7 bytes)
+                  }},
+                  functions...);
+}
+
+/// Packet memory buffer configuration of a single endpoint
+struct pma_buffer
+{
+    /// Endpoint address (bit 7 set for IN endpoints)
+    uint8_t ep_address;
+    /// Buffer size (in bytes)
+    uint16_t size;
+    /// Indicates if the endpoint uses two buffers
+    bool is_double;
+    /// Offset of the (first) buffer in packet memory
+    uint16_t offset;
+    /// Offset of the second buffer (if double-buffered)
+    uint16_t offset2;
+};
+
+/// Size of the packet memory of the STM32F103 (in bytes)
+constexpr uint16_t PMA_SIZE = 512;
+
+/**
+ * Packet memory layout.
+ *
+ * @param N number of endpoint buffers
+ */
+template <size_t N>
+struct pma_layout
+{
+    /// Endpoint buffers (with assigned offsets)
+    pma_buffer buffers[N];
+    /// Number of bytes used (incl. buffer table)
+    uint16_t used;
+};
+
+/// Requests a single packet memory buffer for the specified endpoint
+constexpr pma_buffer single_buffer(uint8_t ep_address, uint16_t size)
+{
+    return pma_buffer{ep_address, size, false, 0, 0};
+}
+
+/// Requests two packet memory buffers for the specified endpoint
+constexpr pma_buffer double_buffer(uint8_t ep_address, uint16_t size)
+{
+    return pma_buffer{ep_address, size, true, 0, 0};
+}
+
+/// Returns the buffer size as allocated by the USB peripheral
+constexpr uint16_t pma_alloc_size(const pma_buffer &buffer)
+{
+    // OUT buffers > 62 bytes are allocated in 32 byte blocks, all others in 2 byte blocks
+    return (buffer.ep_address & 0x80) == 0 && buffer.size > 62 ? (buffer.size + 31) & ~31 : (buffer.size + 1) & ~1;
+}
+
+/**
+ * Computes a non-overlapping packet memory layout.
+ *
+ * The buffer table is placed at offset 0 and occupies 8 bytes per
+ * endpoint number. The buffers are allocated consecutively thereafter.
+ *
+ * @param buffers endpoint buffers (with unset offsets)
+ */
+template <size_t N>
+constexpr pma_layout<N> allocate_pma(const pma_buffer (&buffers)[N])
+{
+    pma_layout<N> layout{};
+
+    // buffer table: 8 bytes per endpoint number
+    uint8_t max_ep_num = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        uint8_t ep_num = buffers[i].ep_address & 0x0f;
+        check(ep_num < 8, "endpoint number must be between 0 and 7");
+        if (ep_num > max_ep_num)
+            max_ep_num = ep_num;
+
+        // each direction of each endpoint has a single entry in the buffer table
+        for (size_t j = 0; j < i; j++)
+            check(buffers[j].ep_address != buffers[i].ep_address, "duplicate endpoint buffer");
+        check(buffers[i].size > 0 && buffers[i].size <= 1023, "invalid buffer size");
+    }
+    uint16_t offset = 8 * (max_ep_num + 1);
+
+    // allocate buffers
+    for (size_t i = 0; i < N; i++)
+    {
+        pma_buffer buffer = buffers[i];
+        uint16_t size = pma_alloc_size(buffer);
+        buffer.offset = offset;
+        offset += size;
+        if (buffer.is_double)
+        {
+            buffer.offset2 = offset;
+            offset += size;
+        }
+        layout.buffers[i] = buffer;
+    }
+
+    check(offset <= PMA_SIZE, "packet memory overflow");
+    layout.used = offset;
+    return layout;
+}
+
+} // namespace usb_desc
+
+#endif
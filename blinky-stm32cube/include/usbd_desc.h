@@ -15,7 +15,32 @@
 
 #include "usbd_def.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WCID_VENDOR_CODE 0x37
+
 /* Descriptor functions */
 extern USBD_DescriptorsTypeDef USBD_Descriptors;
 
+/* Initializes the serial number string descriptor from the unique device ID */
+void USBD_InitSerialNumber(void);
+
+/* Returns the configuration descriptor */
+uint8_t *USBD_GetConfigDescriptor(uint16_t *length);
+
+/* Returns the Microsoft WCID string descriptor (string index 0xee) */
+uint8_t *USBD_GetMsftStrDescriptor(uint16_t *length);
+
+/* Returns the Microsoft WCID feature descriptor (index 0x0004) */
+uint8_t *USBD_GetWcidFeatureDescriptor(uint16_t *length);
+
+/* Configures the packet memory buffers of all endpoints */
+void USBD_ConfigPMA(PCD_HandleTypeDef *hpcd);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -90,6 +90,7 @@ void USB_Device_Init(void)
     HAL_Delay(80);
 
     /* Init USB Device Library, add supported class and start the library. */
+    USBD_InitSerialNumber();
     USBD_Init(&USBD_Device, &USBD_Descriptors, DEVICE_INDEX);
     USBD_RegisterClass(&USBD_Device, &USBD_Vendor_Class);
     USBD_Start(&USBD_Device);
@@ -0,0 +1,210 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * USB device descriptor
+ *
+ * All descriptors are built at compile time (see usb_desc_builder.h)
+ * and reside in flash.
+ */
+
+#include "usbd_core.h"
+#include "usbd_desc.h"
+#include "usbd_conf.h"
+#include "usb_desc_builder.h"
+#include "stm32f1xx_ll_utils.h"
+
+#define USBD_VID 0xcafe
+#define USBD_LANGID_STRING 1033
+#define USBD_MANUFACTURER_STRING "Tutorial"
+#define USBD_PID_FS 0xcafe
+#define USBD_PRODUCT_STRING_FS "Blinky"
+#define USBD_CONFIGURATION_STRING_FS "Blinky Config"
+#define USBD_INTERFACE_STRING_FS "Blinky Interface"
+#define USBD_DEV_RELESE 0x0051
+
+using namespace usb_desc;
+
+static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len);
+
+static uint8_t *GetDeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetLangIDStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetManufacturerStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetProductStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetSerialStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetConfigurationStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+static uint8_t *GetInterfaceStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length);
+
+USBD_DescriptorsTypeDef USBD_Descriptors =
+    {
+        GetDeviceDescriptor,
+        GetLangIDStrDescriptor,
+        GetManufacturerStrDescriptor,
+        GetProductStrDescriptor,
+        GetSerialStrDescriptor,
+        GetConfigurationStrDescriptor,
+        GetInterfaceStrDescriptor,
+};
+
+/* USB device descriptor. */
+alignas(4) static constexpr auto deviceDesc = device(
+    0x0200,                    /* bcdUSB = 2.00 */
+    CLASS_VENDOR,              /* bDeviceClass = vendor specific */
+    USB_MAX_EP0_SIZE,          /* bMaxPacketSize */
+    USBD_VID,                  /* idVendor */
+    USBD_PID_FS,               /* idProduct */
+    USBD_DEV_RELESE,           /* bcdDevice */
+    USBD_IDX_MFC_STR,          /* Index of manufacturer string */
+    USBD_IDX_PRODUCT_STR,      /* Index of product string */
+    USBD_IDX_SERIAL_STR,       /* Index of serial number string */
+    USBD_MAX_NUM_CONFIGURATION /* bNumConfigurations */
+);
+
+/* USB blinky device configuration descriptor */
+alignas(4) static constexpr auto configDesc = configuration(
+    1,                   /* bNumInterfaces: 1 interface */
+    1,                   /* bConfigurationValue: Configuration value */
+    USBD_IDX_CONFIG_STR, /* iConfiguration: Index of string descriptor for configuration */
+    500,                 /* MaxPower 500 mA: this current is used for detecting Vbus */
+    interface(0,                      /* bInterfaceNumber: Number of Interface (no endpoints) */
+              0,                      /* bAlternateSetting: Alternate setting */
+              CLASS_VENDOR,           /* bInterfaceClass: vendor-specific */
+              USBD_IDX_INTERFACE_STR /* iInterface: Index of string descriptor */
+              ));
+
+/* USB lang indentifier descriptor. */
+alignas(4) static constexpr auto langIDDesc = lang_id(USBD_LANGID_STRING);
+
+/* String descriptors (converted to UTF-16 at compile time, serial number at startup) */
+alignas(4) static constexpr auto manufacturerStrDesc = string(USBD_MANUFACTURER_STRING);
+alignas(4) static constexpr auto productStrDesc = string(USBD_PRODUCT_STRING_FS);
+alignas(4) static constexpr auto configurationStrDesc = string(USBD_CONFIGURATION_STRING_FS);
+alignas(4) static constexpr auto interfaceStrDesc = string(USBD_INTERFACE_STRING_FS);
+
+/* Microsoft WCID string descriptor (string index 0xee) */
+alignas(4) static constexpr auto msftSigDesc = msft_os_string(WCID_VENDOR_CODE);
+
+/* Microsoft WCID feature descriptor (index 0x0004) */
+alignas(4) static constexpr auto wcidFeatureDesc = wcid_feature(wcid_function(0, "WINUSB"));
+
+/* Packet memory layout */
+static constexpr pma_buffer pmaBuffers[] = {
+    single_buffer(0x00, USB_MAX_EP0_SIZE), /* endpoint 0 OUT */
+    single_buffer(0x80, USB_MAX_EP0_SIZE), /* endpoint 0 IN */
+};
+static constexpr auto pmaLayout = allocate_pma(pmaBuffers);
+
+#define USB_SIZ_STRING_SERIAL 0x1A
+
+static __ALIGN_BEGIN uint8_t serialStringDesc[USB_SIZ_STRING_SERIAL] __ALIGN_END = {
+    USB_SIZ_STRING_SERIAL,
+    USB_DESC_TYPE_STRING,
+};
+
+template <size_t N>
+static uint8_t *GetDescriptor(const bytes<N> &desc, uint16_t *length)
+{
+    *length = desc.size();
+    return const_cast<uint8_t *>(desc.data);
+}
+
+uint8_t *GetDeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(deviceDesc, length);
+}
+
+uint8_t *GetLangIDStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(langIDDesc, length);
+}
+
+uint8_t *GetProductStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(productStrDesc, length);
+}
+
+uint8_t *GetManufacturerStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(manufacturerStrDesc, length);
+}
+
+uint8_t *GetSerialStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    *length = USB_SIZ_STRING_SERIAL;
+    return serialStringDesc;
+}
+
+uint8_t *GetConfigurationStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(configurationStrDesc, length);
+}
+
+uint8_t *GetInterfaceStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    UNUSED(speed);
+    return GetDescriptor(interfaceStrDesc, length);
+}
+
+uint8_t *USBD_GetConfigDescriptor(uint16_t *length)
+{
+    return GetDescriptor(configDesc, length);
+}
+
+uint8_t *USBD_GetMsftStrDescriptor(uint16_t *length)
+{
+    return GetDescriptor(msftSigDesc, length);
+}
+
+uint8_t *USBD_GetWcidFeatureDescriptor(uint16_t *length)
+{
+    return GetDescriptor(wcidFeatureDesc, length);
+}
+
+void USBD_ConfigPMA(PCD_HandleTypeDef *hpcd)
+{
+    for (const pma_buffer &buffer : pmaLayout.buffers)
+    {
+        if (buffer.is_double)
+            HAL_PCDEx_PMAConfig(hpcd, buffer.ep_address, PCD_DBL_BUF, buffer.offset | ((uint32_t)buffer.offset2 << 16));
+        else
+            HAL_PCDEx_PMAConfig(hpcd, buffer.ep_address, PCD_SNG_BUF, buffer.offset);
+    }
+}
+
+void USBD_InitSerialNumber(void)
+{
+    uint32_t id0 = LL_GetUID_Word0();
+    uint32_t id1 = LL_GetUID_Word1();
+    uint32_t id2 = LL_GetUID_Word2();
+
+    id0 += id2;
+
+    if (id0 != 0)
+    {
+        IntToUnicode(id0, &serialStringDesc[2], 8);
+        IntToUnicode(id1, &serialStringDesc[18], 4);
+    }
+}
+
+const static char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static void IntToUnicode(uint32_t value, uint8_t *pbuf, uint8_t len)
+{
+    uint8_t idx = 0;
+
+    for (idx = 0; idx < len; idx++)
+    {
+        pbuf[2 * idx] = HEX_DIGITS[value >> 28];
+        value = value << 4;
+        pbuf[2 * idx + 1] = 0;
+    }
+}
@@ -12,6 +12,7 @@
 #include "stm32f1xx_hal.h"
 #include "usbd_def.h"
 #include "usbd_core.h"
+#include "usbd_desc.h"
 #include "usbd_vendor.h"
 
 PCD_HandleTypeDef usb_pcd;
@@ -122,9 +123,8 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         Error_Handler();
     }
 
-    /* Configure endpoint 0 */
-    HAL_PCDEx_PMAConfig((PCD_HandleTypeDef *)pdev->pData, 0x00, PCD_SNG_BUF, 0x18);
-    HAL_PCDEx_PMAConfig((PCD_HandleTypeDef *)pdev->pData, 0x80, PCD_SNG_BUF, 0x58);
+    /* Configure packet memory of all endpoints (layout computed at compile time) */
+    USBD_ConfigPMA((PCD_HandleTypeDef *)pdev->pData);
 
     return USBD_OK;
 }
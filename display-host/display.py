@@ -9,6 +9,7 @@
 #
 
 import usb.core
+import time
 from PIL import Image
 
 def rgb888_to_rgb565(r, g, b):
@@ -44,5 +45,15 @@ if dev is None:
 # set configuration
 dev.set_configuration()
 
-# send pixel data
-dev.write(DATA_EP, pixels, 2000)
+# send pixel data (several times for comparing the firmware's single- and double-buffered mode)
+NUM_RUNS = 10
+durations = []
+for _ in range(NUM_RUNS):
+    start_time = time.perf_counter()
+    dev.write(DATA_EP, pixels, 2000)
+    durations.append(time.perf_counter() - start_time)
+duration = min(durations)
+mean = sum(durations) / len(durations)
+print("%d bytes in %0.1f ms (%0.1f KB/s), mean of %d runs: %0.1f ms (%0.1f KB/s)"
+      % (len(pixels), duration * 1000, len(pixels) / duration / 1024, NUM_RUNS, mean * 1000,
+         len(pixels) / mean / 1024))
@@ -0,0 +1,47 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Double-buffered bulk OUT endpoint
+ */
+
+#ifndef USB_DBL_BUF_H
+#define USB_DBL_BUF_H
+
+#include <libopencm3/usb/usbd.h>
+
+/**
+ * @brief Switches a bulk OUT endpoint to double-buffered mode.
+ *
+ * LibOpenCM3 only supports single-buffered endpoints. This function
+ * must be called after `usbd_ep_setup()`. It allocates the second
+ * packet buffer at the top of the packet memory and sets the DBL_BUF
+ * flag of the endpoint.
+ *
+ * Thereafter, packets must be read with `usb_dbl_buf_read_packet()`.
+ * NAK can still be forced with `usbd_ep_nak_set()` as the peripheral
+ * does not change STAT_RX in double-buffered mode.
+ *
+ * @param ep endpoint address
+ * @param max_size maximum packet size (multiple of 32)
+ */
+void usb_dbl_buf_setup(uint8_t ep, uint16_t max_size);
+
+/**
+ * @brief Reads the received packet from a double-buffered OUT endpoint.
+ *
+ * The other packet buffer is handed to the USB peripheral before the
+ * packet is copied so that it can receive the next packet while the
+ * current one is still being copied and processed.
+ *
+ * @param ep endpoint address
+ * @param buf buffer to copy the packet to
+ * @param len length of the buffer
+ * @return number of bytes copied
+ */
+int usb_dbl_buf_read_packet(uint8_t ep, uint8_t *buf, int len);
+
+#endif
@@ -29,6 +29,11 @@ extern const struct usb_device_descriptor usb_device_desc;
 // USB device configurations
 extern const struct usb_config_descriptor usb_config_descs[];
 
-void usb_init_serial_num();
+// Initializes the serial number and builds the string descriptor table
+void usb_init_string_descs();
+
+// Returns the precomputed string descriptor with the given index
+// (or nullptr if it is not available)
+const uint8_t *usb_get_string_desc(int index);
 
 #endif
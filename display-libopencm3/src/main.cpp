@@ -11,6 +11,7 @@
 #include "circ_buf.h"
 #include "common.h"
 #include "display.h"
+#include "usb_dbl_buf.h"
 #include "usb_descriptor.h"
 #include "wcid.h"
 #include <libopencm3/stm32/gpio.h>
@@ -40,6 +41,9 @@ static constexpr int ROW_LEN = 256; /* 128 pixels x 2 byte = 256 bytes */
 // indicates if the endpoint is forced to NAK to prevent receiving further data
 static volatile bool is_forced_nak = false;
 
+// Use double-buffered endpoint (set to false to compare with single-buffered operation)
+static constexpr bool USE_DOUBLE_BUFFER = true;
+
 void init()
 {
     // Enable required clocks
@@ -64,7 +68,7 @@ void usb_init()
     gpio_clear(GPIOA, GPIO12);
     delay(80);
 
-    usb_init_serial_num();
+    usb_init_string_descs();
 
     // create USB device
     usb_device = usbd_init(&st_usbfs_v1_usb_driver, &usb_device_desc, usb_config_descs,
@@ -85,6 +89,8 @@ void usb_set_config(usbd_device *usbd_dev, __attribute__((unused)) uint16_t wVal
 {
     register_wcid_desc(usbd_dev);
     usbd_ep_setup(usbd_dev, EP_DATA_OUT, USB_ENDPOINT_ATTR_BULK, BULK_MAX_PACKET_SIZE, usb_data_received);
+    if (USE_DOUBLE_BUFFER)
+        usb_dbl_buf_setup(EP_DATA_OUT, BULK_MAX_PACKET_SIZE);
 
     buffer.reset();
     is_forced_nak = false;
@@ -93,14 +99,20 @@ void usb_set_config(usbd_device *usbd_dev, __attribute__((unused)) uint16_t wVal
 // Called when data has been received
 void usb_data_received(__attribute__((unused)) usbd_device *usbd_dev, __attribute__((unused)) uint8_t ep)
 {
-    // Retrieve USB data (has side effect of setting endpoint to VALID)
+    // Retrieve USB data (single-buffered: has side effect of setting endpoint to VALID;
+    // double-buffered: releases the other packet buffer for reception, STAT_RX is not changed)
     uint8_t packet[BULK_MAX_PACKET_SIZE] __attribute__((aligned(4)));
-    int len = usbd_ep_read_packet(usb_device, EP_DATA_OUT, packet, sizeof(packet));
+    int len;
+    if (USE_DOUBLE_BUFFER)
+        len = usb_dbl_buf_read_packet(EP_DATA_OUT, packet, sizeof(packet));
+    else
+        len = usbd_ep_read_packet(usb_device, EP_DATA_OUT, packet, sizeof(packet));
 
     // copy data into circular buffer
     buffer.add_data(packet, len);
 
     // check if there is space for less than 2 packets
+    // (in double-buffered mode, a second packet might arrive before the endpoint is set to NAK)
     if (!is_forced_nak && buffer.avail_size() < MIN_FREE_SPACE)
     {
         // set endpoint from VALID to NAK
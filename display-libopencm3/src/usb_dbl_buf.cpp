@@ -0,0 +1,110 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Double-buffered bulk OUT endpoint
+ *
+ * In double-buffered mode, the USB peripheral uses both buffer
+ * descriptors of the endpoint for reception (buffer 0: ADDR_TX/COUNT_TX,
+ * buffer 1: ADDR_RX/COUNT_RX). DTOG_RX selects the buffer the peripheral
+ * writes to next, SW_BUF (the DTOG_TX bit) the buffer owned by the
+ * application. The peripheral toggles DTOG_RX after each received packet
+ * and NAKs while both bits are equal, i.e. while it would have to write
+ * to the buffer owned by the application. STAT_RX remains VALID.
+ *
+ * Setup (as in ST's HAL): DTOG_RX = 0, SW_BUF = 1. The peripheral fills
+ * buffer 0, which sets DTOG_RX to 1. The application first toggles SW_BUF
+ * to 0, releasing buffer 1 for reception, and then reads buffer 0 while
+ * the peripheral can already receive the next packet, and so on.
+ */
+
+#include "usb_dbl_buf.h"
+#include <libopencm3/stm32/st_usbfs.h>
+
+// Size of the packet memory (in bytes)
+static constexpr uint16_t PMA_SIZE = 512;
+
+// Offsets of the fields in the buffer descriptor table entry
+static constexpr int BTABLE_ADDR_TX = 0;
+static constexpr int BTABLE_COUNT_TX = 2;
+static constexpr int BTABLE_ADDR_RX = 4;
+static constexpr int BTABLE_COUNT_RX = 6;
+
+// SW_BUF bit for OUT endpoints (shares the bit with DTOG_TX)
+static constexpr uint16_t USB_EP_SW_BUF_RX = USB_EP_TX_DTOG;
+
+// Returns pointer to a field of the buffer descriptor table
+static volatile uint32_t *btable_field(uint8_t ep, int field)
+{
+    return (volatile uint32_t *)(USB_PMA_BASE + (*USB_BTABLE_REG + (ep & 0x07) * 8 + field) * 2);
+}
+
+// Writes the endpoint register with the toggle bits set in `toggle` being toggled.
+// CTR bits are written as 1 so they are not accidentally cleared.
+static void ep_reg_toggle(uint8_t ep, uint16_t set, uint16_t toggle)
+{
+    uint16_t val = *USB_EP_REG(ep) & USB_EP_NTOGGLE_MSK;
+    *USB_EP_REG(ep) = val | set | toggle | USB_EP_RX_CTR | USB_EP_TX_CTR;
+}
+
+void usb_dbl_buf_setup(uint8_t ep, uint16_t max_size)
+{
+    ep &= 0x07;
+
+    // Place buffer 0 at the top of the packet memory. LibOpenCM3 allocates
+    // packet memory from the bottom and has already allocated buffer 1.
+    uint16_t buf0_addr = PMA_SIZE - max_size;
+    *btable_field(ep, BTABLE_ADDR_TX) = buf0_addr;
+
+    // Use same size configuration as buffer 1 (set by LibOpenCM3)
+    *btable_field(ep, BTABLE_COUNT_TX) = *btable_field(ep, BTABLE_COUNT_RX);
+
+    // Set DBL_BUF flag
+    ep_reg_toggle(ep, USB_EP_KIND, 0);
+
+    // Peripheral starts with buffer 0 (DTOG_RX = 0), application owns buffer 1 (SW_BUF = 1)
+    uint16_t val = *USB_EP_REG(ep);
+    ep_reg_toggle(ep, 0, (val & USB_EP_RX_DTOG) | (~val & USB_EP_SW_BUF_RX));
+
+    USB_SET_EP_RX_STAT(ep, USB_EP_RX_STAT_VALID);
+}
+
+int usb_dbl_buf_read_packet(uint8_t ep, uint8_t *buf, int len)
+{
+    ep &= 0x07;
+
+    USB_CLR_EP_RX_CTR(ep);
+
+    // If DTOG_RX == SW_BUF, the peripheral is blocked: take over the filled
+    // buffer by toggling SW_BUF first so the peripheral can receive into
+    // the other buffer while this one is being copied (as ST's HAL does).
+    uint16_t val = *USB_EP_REG(ep);
+    bool sw_buf = (val & USB_EP_SW_BUF_RX) != 0;
+    if (((val & USB_EP_RX_DTOG) != 0) == sw_buf)
+    {
+        ep_reg_toggle(ep, 0, USB_EP_SW_BUF_RX);
+        sw_buf = !sw_buf;
+    }
+
+    // copy packet from the buffer owned by the application (SW_BUF: 0 for buffer 0, 1 for buffer 1)
+    uint16_t addr = *btable_field(ep, sw_buf ? BTABLE_ADDR_RX : BTABLE_ADDR_TX);
+    int count = *btable_field(ep, sw_buf ? BTABLE_COUNT_RX : BTABLE_COUNT_TX) & 0x3ff;
+    if (count > len)
+        count = len;
+
+    // packet memory is organized as 16-bit words with a 32-bit stride
+    const volatile uint32_t *src = (const volatile uint32_t *)(USB_PMA_BASE + addr * 2);
+    for (int i = 0; i < count / 2; i++)
+    {
+        uint16_t word = *src++;
+        *buf++ = word;
+        *buf++ = word >> 8;
+    }
+    if (count & 1)
+        *buf = (uint8_t)*src;
+
+    return count;
+}
@@ -18,6 +18,9 @@
 
 #define BUF_SIZE 1025
 
+/* Size of the overflow area past the end of the buffer (max. packet size) */
+#define BUF_OVERFLOW_SIZE 64
+
 /// Returns the maximum number of bytes that can be added to the buffer
 int circ_buf_avail_size();
 
@@ -40,6 +43,27 @@ int circ_buf_get_data(uint8_t *buf, int max_len);
  */
 void circ_buf_add_data(const uint8_t *buf, int len);
 
+/**
+ * Returns a pointer to the location where the next data is to be written.
+ * 
+ * At least `BUF_OVERFLOW_SIZE` bytes can be written contiguously
+ * (provided there is enough space in the buffer). Data written
+ * past the end of the circular buffer is moved to its start
+ * by `circ_buf_commit()`.
+ * 
+ * This allows data to be received directly into the buffer.
+ * 
+ * @return pointer to write location
+ */
+uint8_t *circ_buf_write_ptr();
+
+/**
+ * Adds the data written to the location returned by `circ_buf_write_ptr()`
+ * 
+ * @param len the number of bytes written (at most `BUF_OVERFLOW_SIZE`)
+ */
+void circ_buf_commit(int len);
+
 /// Resets (empties) the circular buffer
 void circ_buf_reset();
 
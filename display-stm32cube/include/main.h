@@ -17,9 +17,9 @@
 
 void Error_Handler();
 
-/* Called when data has been received.
+/* Called when data has been received directly into the circular buffer.
  * Returns if USB should continue to receive data on this endpoint. */
-bool usb_data_received(uint8_t* buf, int len);
+bool usb_data_received(int len);
 
 /* Continue receiving data (if it has been stopped previously). */
 void usb_continue_rx(USBD_HandleTypeDef *pdev);
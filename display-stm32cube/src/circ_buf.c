@@ -24,7 +24,9 @@
 static volatile int buf_head = 0; // updated when adding data
 static volatile int buf_tail = 0; // updated when removing data
 
-static uint8_t buffer[BUF_SIZE];
+// The buffer is followed by an overflow area so that data can be
+// written contiguously at the head even if it wraps around.
+static uint8_t buffer[BUF_SIZE + BUF_OVERFLOW_SIZE];
 
 int circ_buf_avail_size()
 {
@@ -109,6 +111,27 @@ void circ_buf_add_data(const uint8_t *buf, int len)
     buf_head = head;
 }
 
+uint8_t *circ_buf_write_ptr()
+{
+    return buffer + buf_head;
+}
+
+void circ_buf_commit(int len)
+{
+    int head = buf_head;
+
+    // move part written to overflow area to start of circular buffer
+    int n = head + len - BUF_SIZE;
+    if (n > 0)
+        memcpy(buffer, buffer + BUF_SIZE, n);
+
+    // update head
+    head += len;
+    if (head >= BUF_SIZE)
+        head -= BUF_SIZE;
+    buf_head = head;
+}
+
 void circ_buf_reset()
 {
     buf_head = 0;
@@ -63,10 +63,10 @@ void usb_check_stop()
     }
 }
 
-bool usb_data_received(uint8_t *buf, int len)
+bool usb_data_received(int len)
 {
-    // add recievied data to circular buffer
-    circ_buf_add_data(buf, len);
+    // add recievied data to circular buffer (already copied to write location)
+    circ_buf_commit(len);
 
     bool has_space = circ_buf_avail_size() >= DATA_PACKET_SIZE;
     if (!has_space)
@@ -124,6 +124,7 @@ void USB_Device_Init(void)
     HAL_Delay(80);
 
     /* Init USB Device Library, add supported class and start the library. */
+    USBD_InitSerialNumber();
     USBD_Init(&USBD_Device, &USBD_Descriptors, DEVICE_INDEX);
     USBD_RegisterClass(&USBD_Device, &USBD_Vendor_Class);
     USBD_Start(&USBD_Device);
@@ -8,23 +8,88 @@
 # Voltage logger (from host)
 #
 
-import usb.core
-import struct
+import time
+import logger_device
+import logger_packet
+import logger_stats
 
-COMM_EP = 1
-DATA_EP = 129
+SAMPLE_RATE = 100  # samples per second
+CHANNELS = [0]  # channel n is on pin PAn
+MODE = logger_device.MODE_NORMAL  # or MODE_FAST_INTERLEAVED (single channel, 1.7 or 1.3 million samples/s)
+DECIMATION = 1  # 1, 2, 4, ... 256 (average of oversampled values)
+TRIGGER = logger_device.TRIGGER_OFF  # or TRIGGER_RISING_EDGE etc. for triggered capture
+TRIGGER_CHANNEL = 0
+TRIGGER_LEVEL = 2048  # in sample units (4095 = VDDA; 65520 = VDDA if decimation is enabled)
+PRE_TRIGGER = 100  # frames before trigger
+POST_TRIGGER = 400  # frames starting with trigger frame
+ALARM = logger_device.ALARM_BOTH  # or ALARM_OFF, ALARM_RISING, ALARM_FALLING
+ALARM_CHANNEL = 0
+ALARM_LEVEL = 3000  # in sample units
+ALARM_HYSTERESIS = 100  # in sample units
+FLUSH_TIMEOUT = 50  # ms until a partially filled packet is transmitted (0 = full packets only)
+STATS_THRESHOLD = 2048  # threshold for counting crossings (in sample units)
+SAMPLE_FORMAT = logger_packet.FORMAT_DELTA_RICE  # or FORMAT_RAW16, FORMAT_PACKED12
 
-# find device
-dev = usb.core.find(idVendor=0xcafe, idProduct=0xbabe)
-if dev is None:
-    raise ValueError('Device not found')
+# find device and configure it
+logger = logger_device.Logger()
+logger.configure(channels=CHANNELS, mode=MODE, decimation=DECIMATION, sample_rate=SAMPLE_RATE,
+                 sample_format=SAMPLE_FORMAT, flush_timeout=FLUSH_TIMEOUT,
+                 trigger=logger_device.Trigger(TRIGGER, TRIGGER_CHANNEL, TRIGGER_LEVEL, PRE_TRIGGER, POST_TRIGGER),
+                 alarm=logger_device.Alarm(ALARM, ALARM_CHANNEL, ALARM_LEVEL, ALARM_HYSTERESIS))
+config = logger.config()
+print("Sample rate: %d samples/s, channels %s, supply voltage %0.3fV"
+      % (config.sample_rate, config.channels, config.vdda / 1000))
 
-# set configuration
-dev.set_configuration()
+num_dropped = 0
+next_check = time.monotonic() + 1
+tracker = logger_packet.PacketTracker()
+stats = logger_stats.StatsWorker(logger_stats.StreamStats(
+    len(config.channels), STATS_THRESHOLD, 65536 if DECIMATION > 1 else 4096))
+
+EVENT_NAMES = {
+    logger_device.EVENT_ALARM_RISING: "Alarm (rising)",
+    logger_device.EVENT_ALARM_FALLING: "Alarm (falling)",
+    logger_device.EVENT_OVERRUN: "Overrun",
+    logger_device.EVENT_TRIGGER: "Trigger",
+}
+
+
+def on_event(event):
+    # latency from the event to its reception, using the device-to-host time mapping of the data stream
+    # (relative to the fastest data packet, i.e. it excludes the minimum transfer latency)
+    latency = ""
+    if tracker.sample_rate is not None:
+        device_time = tracker.device_time(event.timestamp)
+        latency = ", latency %0.1f ms" % ((event.host_time - tracker.host_time(device_time)) * 1000)
+    print("*** %s: channel %d, value %d%s ***"
+          % (EVENT_NAMES.get(event.type, "Event %d" % event.type), event.channel, event.value, latency))
+
+
+# events are delivered by a separate thread, independent of the data stream
+events = logger.start_events(on_event)
 
 while True:
-    samples = struct.unpack('HHHHHHHHHH', dev.read(DATA_EP, 20))
-    for sample in samples:
-        voltage = sample * 3.3 / 4095
-        print("%0.2fV" % voltage)
+    packet = logger.read_packet()
+    packet_time, has_gap = tracker.add(packet, time.monotonic())
+    if packet.window_start:
+        print("--- trigger ---")
+    elif has_gap:
+        print("Warning: gap before packet %d" % packet.seq)
+    stats.add(packet.samples)
+    for frame in logger_packet.millivolts(packet).T:
+        print("  ".join("%0.3fV" % (voltage / 1000) for voltage in frame))
+
+    # check for dropped samples once per second
+    if time.monotonic() >= next_check:
+        next_check += 1
+        dropped = logger.counters().num_dropped_samples
+        if dropped != num_dropped:
+            print("Warning: %d samples dropped" % (dropped - num_dropped))
+            num_dropped = dropped
+        if tracker.sample_rate is not None:
+            print("Measured sample rate: %0.1f samples/s" % tracker.sample_rate)
+        mean, std, min_value, max_value, _, crossings = stats.snapshot()
+        for i, channel in enumerate(packet.channels):
+            print("Channel %d: mean %0.1f, std %0.1f, min %d, max %d, %d crossings"
+                  % (channel, mean[i], std[i], min_value[i], max_value[i], crossings[i]))
 
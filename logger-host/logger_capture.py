@@ -0,0 +1,128 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: capture file (memory-mapped binary format)
+#
+# The file is preallocated and consists of:
+# - header (64 bytes, see HEADER_FORMAT)
+# - index: one record per packet (see INDEX_DTYPE)
+# - data: one slot of 64 bytes per packet (raw packet as received, zero padded)
+#
+# The number of packets in the header is updated after the packet and
+# its index record have been written. So readers can open the file
+# while it is still being recorded and see all packets up to this number.
+#
+
+import mmap
+import struct
+import numpy as np
+import logger_packet
+
+MAGIC = b'LOGCAP01'
+VERSION = 1
+HEADER_SIZE = 64
+SLOT_SIZE = 64
+
+# magic, version, slot size, capacity (packets), number of packets, sample rate, channel mask, start time (host)
+HEADER_FORMAT = '<8sHHIQIB3xd'
+NUM_PACKETS_OFFSET = 16
+
+# index record of each packet
+INDEX_DTYPE = np.dtype([
+    ('host_time', '<f8'),  # time the packet was received (host time, in s)
+    ('timestamp', '<u4'),  # time of first frame (device time, in µs)
+    ('seq', '<u2'),        # sequence number
+    ('length', 'u1'),      # packet length (in bytes)
+    ('format', 'u1'),      # format byte of packet header (including flags)
+])
+
+
+class CaptureWriter:
+    """Writes packets to a new capture file"""
+
+    def __init__(self, path, capacity, sample_rate, channel_mask, start_time):
+        self.capacity = capacity
+        self.num_packets = 0
+        self._index_offset = HEADER_SIZE
+        self._data_offset = HEADER_SIZE + capacity * INDEX_DTYPE.itemsize
+
+        # preallocate file and map it into memory
+        size = self._data_offset + capacity * SLOT_SIZE
+        self._file = open(path, 'w+b')
+        self._file.truncate(size)
+        self._mm = mmap.mmap(self._file.fileno(), size)
+        struct.pack_into(HEADER_FORMAT, self._mm, 0, MAGIC, VERSION, SLOT_SIZE, capacity, 0,
+                         sample_rate, channel_mask, start_time)
+
+    def append(self, packet, host_time):
+        """Appends a packet. Returns False if the capture file is full."""
+        if self.num_packets >= self.capacity:
+            return False
+
+        n = self.num_packets
+        data_offset = self._data_offset + n * SLOT_SIZE
+        self._mm[data_offset:data_offset + len(packet)] = packet
+
+        packet_format, _, _, seq, timestamp = struct.unpack_from('<BBBHI', packet)
+        struct.pack_into('<dIHBB', self._mm, self._index_offset + n * INDEX_DTYPE.itemsize,
+                         host_time, timestamp, seq, len(packet), packet_format)
+
+        # publish packet to readers
+        self.num_packets = n + 1
+        struct.pack_into('<Q', self._mm, NUM_PACKETS_OFFSET, self.num_packets)
+        return True
+
+    def close(self):
+        """Closes the file (without truncating the unused capacity)"""
+        self._mm.flush()
+        self._mm.close()
+        self._file.close()
+
+
+class CaptureReader:
+    """Reads a capture file (zero-copy, also while it is being recorded)"""
+
+    def __init__(self, path):
+        self._mm = np.memmap(path, dtype=np.uint8, mode='r')
+        magic, version, slot_size, capacity, _, sample_rate, channel_mask, start_time = \
+            struct.unpack_from(HEADER_FORMAT, self._mm)
+        if magic != MAGIC or version != VERSION or slot_size != SLOT_SIZE:
+            raise ValueError('Not a logger capture file: %s' % path)
+
+        self.capacity = capacity
+        self.sample_rate = sample_rate
+        self.channel_mask = channel_mask
+        self.start_time = start_time
+
+        index_size = capacity * INDEX_DTYPE.itemsize
+        self._index = self._mm[HEADER_SIZE:HEADER_SIZE + index_size].view(INDEX_DTYPE)
+        data_offset = HEADER_SIZE + index_size
+        self._data = self._mm[data_offset:data_offset + capacity * SLOT_SIZE].reshape(capacity, SLOT_SIZE)
+
+    @property
+    def num_packets(self):
+        """Number of packets recorded so far"""
+        return int(self._mm[NUM_PACKETS_OFFSET:NUM_PACKETS_OFFSET + 8].view('<u8')[0])
+
+    @property
+    def index(self):
+        """Index records of the recorded packets (structured array, see INDEX_DTYPE)"""
+        return self._index[:self.num_packets]
+
+    @property
+    def packets(self):
+        """Raw packets (2D array of bytes with a row per packet, see `index` for length)"""
+        return self._data[:self.num_packets]
+
+    def decode(self, start=0, stop=None):
+        """Decodes the packets in the given range. Yields a `logger_packet.Packet` for each packet."""
+        if stop is None:
+            stop = self.num_packets
+        index = self._index
+        for i in range(start, stop):
+            yield logger_packet.decode_packet(self._data[i, :index[i]['length']])
+
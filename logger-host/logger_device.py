@@ -0,0 +1,268 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: device API (configuration via vendor control requests)
+#
+
+import collections
+import struct
+import threading
+import time
+import usb.core
+import logger_packet
+
+DATA_EP = 129
+DATA_PACKET_SIZE = 64
+EVENT_EP = 130
+EVENT_PACKET_SIZE = 16
+
+# Alternate settings of the interface
+ALTSETTING_BULK = 0  # bulk endpoint (no guaranteed bandwidth)
+ALTSETTING_ISO_LOW = 1  # isochronous endpoint, 1 data packet per frame
+ALTSETTING_ISO_HIGH = 2  # isochronous endpoint, 2 data packets per frame
+
+# Vendor requests
+SAMPLE_RATE_ID = 0x40
+COUNTERS_ID = 0x41
+FORMAT_ID = 0x42
+CHANNELS_ID = 0x43
+MODE_ID = 0x44
+DECIMATION_ID = 0x45
+TRIGGER_ID = 0x46
+FLUSH_TIMEOUT_ID = 0x47
+CONFIG_ID = 0x48
+ALARM_ID = 0x49
+
+# Sampling modes
+MODE_NORMAL = 0
+MODE_FAST_INTERLEAVED = 1  # single channel, ADC1 and ADC2 interleaved (1.7 or 1.3 million samples/s)
+
+# Trigger modes
+TRIGGER_OFF = 0
+TRIGGER_RISING_EDGE = 1
+TRIGGER_FALLING_EDGE = 2
+TRIGGER_ABOVE_LEVEL = 3
+TRIGGER_BELOW_LEVEL = 4
+
+# Alarm modes (bit flags)
+ALARM_OFF = 0
+ALARM_RISING = 1
+ALARM_FALLING = 2
+ALARM_BOTH = 3
+
+# Event types
+EVENT_ALARM_RISING = 1  # value has risen to or above alarm level
+EVENT_ALARM_FALLING = 2  # value has fallen below alarm level minus hysteresis
+EVENT_OVERRUN = 3  # device has started dropping samples (value: number of dropped samples)
+EVENT_TRIGGER = 4  # trigger has fired
+
+# Trigger configuration (level in sample units, pre_trigger and post_trigger in frames)
+Trigger = collections.namedtuple('Trigger', ['mode', 'channel', 'level', 'pre_trigger', 'post_trigger'])
+TRIGGER_FORMAT = '<BBHHH'
+
+# Alarm configuration (level and hysteresis in sample units)
+Alarm = collections.namedtuple('Alarm', ['mode', 'channel', 'level', 'hysteresis'])
+ALARM_FORMAT = '<BBHH'
+
+# Event (timestamp: device time in µs, wraps around; host_time: time the event was received)
+Event = collections.namedtuple('Event', ['type', 'channel', 'value', 'timestamp', 'host_time'])
+EVENT_FORMAT = '<BBHI'
+
+# Active configuration
+Config = collections.namedtuple('Config', ['sample_rate', 'channels', 'sample_format', 'mode', 'decimation',
+                                           'flush_timeout', 'vdda', 'trigger', 'alarm'])
+CONFIG_FORMAT = '<IBBBHHH'
+
+# Counters
+Counters = collections.namedtuple('Counters', ['num_samples', 'num_dropped_samples', 'num_triggers'])
+
+
+def iso_packet_size(altsetting):
+    """Returns the maximum isochronous packet size of the alternate setting (data packets prefixed with length)"""
+    return altsetting * (1 + DATA_PACKET_SIZE)
+
+
+def channel_mask(channels):
+    """Returns the channel mask for the list of channel numbers"""
+    mask = 0
+    for ch in channels:
+        mask |= 1 << ch
+    return mask
+
+
+class Logger:
+    """Voltage logger device"""
+
+    def __init__(self, dev=None):
+        if dev is None:
+            dev = usb.core.find(idVendor=0xcafe, idProduct=0xbabe)
+            if dev is None:
+                raise ValueError('Device not found')
+        self.dev = dev
+        dev.set_configuration()
+
+    def _set(self, request, value=0, data=None):
+        self.dev.ctrl_transfer(0x41, request, value, 0, data)
+
+    def _get(self, request, length):
+        return bytes(self.dev.ctrl_transfer(0xc1, request, 0, 0, length))
+
+    @property
+    def sample_rate(self):
+        """Sample rate (in samples per second and channel, after decimation)"""
+        return struct.unpack('<I', self._get(SAMPLE_RATE_ID, 4))[0]
+
+    @sample_rate.setter
+    def sample_rate(self, rate):
+        self._set(SAMPLE_RATE_ID, data=struct.pack('<I', rate))
+
+    @property
+    def channels(self):
+        """List of sampled channels (channel n is on pin PAn)"""
+        return logger_packet.channel_list(self._get(CHANNELS_ID, 1)[0])
+
+    @channels.setter
+    def channels(self, channels):
+        self._set(CHANNELS_ID, channel_mask(channels))
+
+    @property
+    def sample_format(self):
+        """Sample format (see logger_packet.FORMAT_...)"""
+        return self._get(FORMAT_ID, 1)[0]
+
+    @sample_format.setter
+    def sample_format(self, sample_format):
+        self._set(FORMAT_ID, sample_format)
+
+    @property
+    def mode(self):
+        """Sampling mode (MODE_NORMAL or MODE_FAST_INTERLEAVED)"""
+        return self._get(MODE_ID, 1)[0]
+
+    @mode.setter
+    def mode(self, mode):
+        self._set(MODE_ID, mode)
+
+    @property
+    def decimation(self):
+        """Decimation ratio (1, 2, 4, ... 256; 1 if disabled)"""
+        return struct.unpack('<H', self._get(DECIMATION_ID, 2))[0]
+
+    @decimation.setter
+    def decimation(self, ratio):
+        self._set(DECIMATION_ID, ratio)
+
+    @property
+    def flush_timeout(self):
+        """Time after which a partially filled packet is transmitted (in ms, 0 to only transmit full packets)"""
+        return struct.unpack('<H', self._get(FLUSH_TIMEOUT_ID, 2))[0]
+
+    @flush_timeout.setter
+    def flush_timeout(self, timeout):
+        self._set(FLUSH_TIMEOUT_ID, timeout)
+
+    @property
+    def trigger(self):
+        """Trigger configuration (`Trigger` tuple)"""
+        return Trigger._make(struct.unpack(TRIGGER_FORMAT, self._get(TRIGGER_ID, struct.calcsize(TRIGGER_FORMAT))))
+
+    @trigger.setter
+    def trigger(self, trigger):
+        self._set(TRIGGER_ID, data=struct.pack(TRIGGER_FORMAT, *trigger))
+
+    @property
+    def alarm(self):
+        """Alarm configuration (`Alarm` tuple)"""
+        return Alarm._make(struct.unpack(ALARM_FORMAT, self._get(ALARM_ID, struct.calcsize(ALARM_FORMAT))))
+
+    @alarm.setter
+    def alarm(self, alarm):
+        self._set(ALARM_ID, data=struct.pack(ALARM_FORMAT, *alarm))
+
+    def configure(self, channels=None, mode=None, decimation=None, sample_rate=None, sample_format=None,
+                  flush_timeout=None, trigger=None, alarm=None):
+        """Sets several configuration values (in an order satisfying their dependencies)"""
+        # fast interleaved mode requires a single channel
+        if mode == MODE_FAST_INTERLEAVED and channels is not None:
+            self.channels = channels
+            self.mode = mode
+        else:
+            if mode is not None:
+                self.mode = mode
+            if channels is not None:
+                self.channels = channels
+        # the sample rate is kept when changing the decimation ratio
+        if decimation is not None:
+            self.decimation = decimation
+        if sample_rate is not None:
+            self.sample_rate = sample_rate
+        if sample_format is not None:
+            self.sample_format = sample_format
+        if flush_timeout is not None:
+            self.flush_timeout = flush_timeout
+        if trigger is not None:
+            self.trigger = trigger
+        if alarm is not None:
+            self.alarm = alarm
+
+    def config(self):
+        """Reads the active configuration (`Config` tuple)"""
+        trigger_offset = struct.calcsize(CONFIG_FORMAT)
+        alarm_offset = trigger_offset + struct.calcsize(TRIGGER_FORMAT)
+        data = self._get(CONFIG_ID, alarm_offset + struct.calcsize(ALARM_FORMAT))
+        values = struct.unpack_from(CONFIG_FORMAT, data)
+        trigger = Trigger._make(struct.unpack_from(TRIGGER_FORMAT, data, trigger_offset))
+        alarm = Alarm._make(struct.unpack_from(ALARM_FORMAT, data, alarm_offset))
+        return Config(values[0], logger_packet.channel_list(values[1]), *values[2:], trigger, alarm)
+
+    def counters(self):
+        """Reads the counters (`Counters` tuple)"""
+        return Counters._make(struct.unpack('<III', self._get(COUNTERS_ID, 12)))
+
+    def read(self, timeout=None):
+        """Reads the next data packet (raw bytes)"""
+        return self.dev.read(DATA_EP, DATA_PACKET_SIZE, timeout)
+
+    def read_packet(self, timeout=None):
+        """Reads and decodes the next data packet (`logger_packet.Packet` tuple)"""
+        return logger_packet.decode_packet(self.read(timeout))
+
+    def start_events(self, callback):
+        """Starts delivering events (alarms, overruns, trigger) to `callback` (see `EventListener`)"""
+        return EventListener(self.dev, callback)
+
+
+class EventListener:
+    """Reads events from the interrupt endpoint in a dedicated thread.
+
+    The callback is called with an `Event` tuple as soon as the event
+    has been received, independent of the data stream. It is called from
+    the listener thread and should return quickly.
+    """
+
+    def __init__(self, dev, callback):
+        self._dev = dev
+        self._callback = callback
+        self._stop_event = threading.Event()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        """Stops the listener thread"""
+        self._stop_event.set()
+        self._thread.join()
+
+    def _run(self):
+        size = struct.calcsize(EVENT_FORMAT)
+        while not self._stop_event.is_set():
+            try:
+                data = bytes(self._dev.read(EVENT_EP, EVENT_PACKET_SIZE, 100))
+            except usb.core.USBTimeoutError:
+                continue
+            host_time = time.monotonic()
+            for offset in range(0, len(data) - size + 1, size):
+                self._callback(Event(*struct.unpack_from(EVENT_FORMAT, data, offset), host_time))
@@ -0,0 +1,166 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: streaming via the isochronous endpoint (guaranteed bandwidth)
+#
+# Requires python-libusb1 (pip install libusb1) as PyUSB does not
+# support isochronous transfers.
+#
+# Each isochronous packet (one per frame, i.e. per ms) contains up to
+# 1 or 2 data packets, depending on the alternate setting, each prefixed
+# with its length. Packets lost on the bus are not retransmitted; they
+# show up as gaps in the sequence numbers.
+#
+
+import time
+import usb1
+import logger_device
+import logger_packet
+
+SAMPLE_RATE = 10000  # samples per second
+CHANNELS = [0]  # channel n is on pin PAn
+FLUSH_TIMEOUT = 10  # ms until a partially filled packet is transmitted (0 = full packets only)
+SAMPLE_FORMAT = logger_packet.FORMAT_DELTA_RICE  # or FORMAT_RAW16, FORMAT_PACKED12
+
+NUM_TRANSFERS = 4  # number of transfers submitted concurrently
+ISO_PACKETS_PER_TRANSFER = 16  # frames per transfer (bounds the latency)
+
+
+class Usb1Device:
+    """Adapter providing the PyUSB methods used by `logger_device.Logger` for a python-libusb1 handle"""
+
+    def __init__(self, handle):
+        self.handle = handle
+
+    def set_configuration(self):
+        pass  # configuration is set before claiming the interface
+
+    def ctrl_transfer(self, bmRequestType, bRequest, wValue=0, wIndex=0, data_or_wLength=None, timeout=1000):
+        if bmRequestType & usb1.ENDPOINT_IN:
+            return self.handle.controlRead(bmRequestType, bRequest, wValue, wIndex, data_or_wLength, timeout)
+        return self.handle.controlWrite(bmRequestType, bRequest, wValue, wIndex, data_or_wLength or b'', timeout)
+
+
+def select_altsetting(sample_rate, num_channels, sample_format, flush_timeout):
+    """Returns the alternate setting providing enough bandwidth (or None if the rate is too high)"""
+    # estimate for uncompressed samples (delta compression usually needs fewer packets)
+    payload_size = logger_device.DATA_PACKET_SIZE - logger_packet.HEADER_SIZE
+    if sample_format == logger_packet.FORMAT_PACKED12:
+        samples_per_packet = payload_size * 2 // 3
+    else:
+        samples_per_packet = payload_size // 2
+    frames_per_packet = samples_per_packet // num_channels
+    packets_per_ms = sample_rate / frames_per_packet / 1000
+    if flush_timeout > 0:
+        packets_per_ms += 1 / flush_timeout
+
+    # leave some headroom for packets that are not completely filled
+    if packets_per_ms <= 0.8:
+        return logger_device.ALTSETTING_ISO_LOW
+    if packets_per_ms <= 1.6:
+        return logger_device.ALTSETTING_ISO_HIGH
+    return None
+
+
+def split_iso_packet(data):
+    """Splits an isochronous packet into the contained data packets"""
+    packets = []
+    i = 0
+    while i < len(data):
+        n = data[i]
+        packets.append(data[i + 1:i + 1 + n])
+        i += 1 + n
+    return packets
+
+
+def main():
+    with usb1.USBContext() as context:
+        handle = context.openByVendorIDAndProductID(0xcafe, 0xbabe, skip_on_error=True)
+        if handle is None:
+            raise ValueError('Device not found')
+        handle.setConfiguration(1)
+
+        with handle.claimInterface(0):
+            logger = logger_device.Logger(Usb1Device(handle))
+            logger.configure(channels=CHANNELS, sample_rate=SAMPLE_RATE, sample_format=SAMPLE_FORMAT,
+                             flush_timeout=FLUSH_TIMEOUT)
+            rate = logger.sample_rate
+            altsetting = select_altsetting(rate, len(CHANNELS), SAMPLE_FORMAT, FLUSH_TIMEOUT)
+            if altsetting is None:
+                raise ValueError('Sample rate too high for isochronous transfers (use bulk endpoint)')
+            handle.setInterfaceAltSetting(0, altsetting)
+            print("Sample rate: %d samples/s, alternate setting %d" % (rate, altsetting))
+
+            tracker = logger_packet.PacketTracker()
+            state = {'running': True, 'packets': 0, 'frames': 0, 'errors': 0, 'transfer_errors': 0}
+
+            def transfer_completed(transfer):
+                transfer_status = transfer.getStatus()
+                if transfer_status in (usb1.TRANSFER_CANCELLED, usb1.TRANSFER_NO_DEVICE):
+                    return  # shutting down
+
+                if transfer_status != usb1.TRANSFER_COMPLETED:
+                    # transient error (e.g. timeout or overflow): keep the transfer in flight
+                    state['transfer_errors'] += 1
+                else:
+                    now = time.monotonic()
+                    for status, data in transfer.iterISO():
+                        if status != usb1.TRANSFER_COMPLETED:
+                            state['errors'] += 1
+                            continue
+                        for raw_packet in split_iso_packet(data):
+                            packet = logger_packet.decode_packet(raw_packet)
+                            tracker.add(packet, now)
+                            state['packets'] += 1
+                            state['frames'] += packet.samples.shape[1]
+
+                if state['running']:
+                    transfer.submit()
+
+            max_packet_size = logger_device.iso_packet_size(altsetting)
+            transfers = []
+            for _ in range(NUM_TRANSFERS):
+                transfer = handle.getTransfer(iso_packets=ISO_PACKETS_PER_TRANSFER)
+                transfer.setIsochronous(logger_device.DATA_EP, ISO_PACKETS_PER_TRANSFER * max_packet_size,
+                                        callback=transfer_completed)
+                transfer.submit()
+                transfers.append(transfer)
+
+            num_dropped = 0
+            next_check = time.monotonic() + 1
+            try:
+                while True:
+                    context.handleEventsTimeout(0.1)
+                    if time.monotonic() < next_check:
+                        continue
+
+                    # report once per second
+                    next_check += 1
+                    dropped = logger.counters().num_dropped_samples
+                    print("%d packets, %d frames, %d gaps, %d frame errors, %d transfer errors, "
+                          "%d samples dropped by device"
+                          % (state['packets'], state['frames'], tracker.num_gaps, state['errors'],
+                             state['transfer_errors'], dropped - num_dropped))
+                    num_dropped = dropped
+                    if tracker.sample_rate is not None:
+                        print("Measured sample rate: %0.1f samples/s" % tracker.sample_rate)
+            except KeyboardInterrupt:
+                pass
+
+            state['running'] = False
+            for transfer in transfers:
+                try:
+                    transfer.cancel()
+                except usb1.USBErrorNotFound:
+                    pass  # already completed
+            while any(transfer.isSubmitted() for transfer in transfers):
+                context.handleEventsTimeout(0.1)
+            handle.setInterfaceAltSetting(0, logger_device.ALTSETTING_BULK)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,207 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: decoding of data packets
+#
+
+import collections
+import struct
+import numpy as np
+
+# Sample formats (first byte of packet header)
+FORMAT_RAW16 = 0
+FORMAT_PACKED12 = 1
+FORMAT_DELTA_RICE = 2
+# Flag in format byte: 16-bit samples (decimation enabled)
+FORMAT_FLAG_16BIT = 0x80
+# Flag in format byte: first packet of captured window (triggered capture)
+FORMAT_FLAG_WINDOW_START = 0x40
+
+HEADER_SIZE = 11
+
+# Rice code parameters (delta format)
+RICE_ESCAPE = 15
+RICE_ESCAPE_BITS = 17
+
+
+def unpack12(payload, num_samples):
+    """Unpacks 12-bit samples (two samples in 3 bytes) into an array of 16-bit values"""
+    data = np.frombuffer(payload, dtype=np.uint8)
+    pad = -len(data) % 3
+    if pad != 0:
+        data = np.concatenate((data, np.zeros(pad, dtype=np.uint8)))
+    triplets = data.reshape(-1, 3).astype(np.uint16)
+
+    samples = np.empty(2 * len(triplets), dtype=np.uint16)
+    samples[0::2] = triplets[:, 0] | ((triplets[:, 1] & 0x0f) << 8)
+    samples[1::2] = (triplets[:, 1] >> 4) | (triplets[:, 2] << 4)
+    return samples[:num_samples]
+
+
+def decode_delta_rice(payload, num_samples, num_channels):
+    """Decodes delta compressed samples (Rice coded zig-zag deltas to previous sample of same channel)
+
+    The decoding is vectorized: the position of the next code is calculated for every bit
+    position, and the start positions of the codes are found by pointer doubling.
+    """
+    k = payload[0]
+    samples = np.empty(num_samples, dtype=np.uint16)
+    if num_samples == 0:
+        return samples
+
+    # key frame
+    key_frame_end = 1 + 2 * num_channels
+    key_frame = np.frombuffer(payload[1:key_frame_end], dtype='<u2').astype(np.int64)
+    num_codes = num_samples - num_channels
+    if num_codes == 0:
+        samples[:] = key_frame
+        return samples
+
+    bits = np.unpackbits(np.frombuffer(payload[key_frame_end:], dtype=np.uint8), bitorder='little')
+    num_bits = len(bits)
+    positions = np.arange(num_bits + 1)
+
+    # value of the RICE_ESCAPE_BITS bits (LSB first) starting at each position
+    padded = np.concatenate((bits, np.zeros(RICE_ESCAPE + RICE_ESCAPE_BITS, dtype=np.uint8)))
+    windows = np.lib.stride_tricks.sliding_window_view(padded, RICE_ESCAPE_BITS)
+    values = windows @ (1 << np.arange(RICE_ESCAPE_BITS))
+
+    # position of the next zero bit (terminating the unary code) at or after each position
+    zero_pos = np.where(np.append(bits == 0, True), positions, num_bits)
+    next_zero = np.minimum.accumulate(zero_pos[::-1])[::-1]
+    q = next_zero - positions
+    escaped = q >= RICE_ESCAPE
+
+    # position of the next code if a code starts at the given position (the end is a fixed point)
+    next_pos = np.where(escaped, positions + RICE_ESCAPE + RICE_ESCAPE_BITS, next_zero + 1 + k)
+    next_pos = np.minimum(next_pos, num_bits)
+
+    # start positions of the codes (in order): each step doubles the number of known codes
+    starts = np.zeros(1, dtype=np.intp)
+    while len(starts) < num_codes:
+        starts = np.concatenate((starts, next_pos[starts]))
+        next_pos = next_pos[next_pos]
+    starts = starts[:num_codes]
+
+    remainder = values[np.minimum(next_zero[starts] + 1, num_bits)] & ((1 << k) - 1)
+    zz = np.where(escaped[starts], values[starts + RICE_ESCAPE], (q[starts] << k) | remainder)
+    deltas = (zz >> 1) ^ -(zz & 1)
+
+    frames = np.concatenate((key_frame, deltas)).reshape(-1, num_channels)
+    samples[:] = np.cumsum(frames, axis=0).ravel()
+    return samples
+
+
+def millivolts(packet):
+    """Returns the samples of the packet converted to millivolts (using the measured supply voltage)"""
+    return packet.samples * (packet.vdda / packet.full_scale)
+
+
+def channel_list(channel_mask):
+    """Returns the list of channel numbers contained in the channel mask"""
+    return [ch for ch in range(8) if channel_mask & (1 << ch)]
+
+
+# Decoded data packet:
+# channels: list of channel numbers
+# samples: 2D array of 16-bit values with a row of samples for each channel
+# seq: sequence number (16-bit, skips a number if samples have been dropped)
+# timestamp: time of first frame (in µs, 32-bit device time, wraps around)
+# full_scale: sample value corresponding to the reference voltage (4095 for 12-bit samples, 65520 for 16-bit samples)
+# window_start: True if the packet is the first one of a captured window (triggered capture)
+# vdda: supply voltage (in mV), corresponding to the full scale value (measured by the device)
+Packet = collections.namedtuple('Packet', ['channels', 'samples', 'seq', 'timestamp', 'full_scale', 'window_start',
+                                           'vdda'])
+
+
+def decode_packet(packet):
+    """Decodes a data packet and returns it as a `Packet` tuple."""
+    packet = bytes(packet)
+    sample_format, channel_mask, num_samples, seq, timestamp, vdda = struct.unpack('<BBBHIH', packet[:HEADER_SIZE])
+    payload = packet[HEADER_SIZE:]
+    full_scale = 4095 * 16 if sample_format & FORMAT_FLAG_16BIT else 4095
+    window_start = (sample_format & FORMAT_FLAG_WINDOW_START) != 0
+    sample_format &= ~(FORMAT_FLAG_16BIT | FORMAT_FLAG_WINDOW_START)
+    channels = channel_list(channel_mask)
+
+    if sample_format == FORMAT_RAW16:
+        samples = np.frombuffer(payload, dtype='<u2', count=num_samples)
+    elif sample_format == FORMAT_PACKED12:
+        samples = unpack12(payload, num_samples)
+    elif sample_format == FORMAT_DELTA_RICE:
+        samples = decode_delta_rice(payload, num_samples, len(channels))
+    else:
+        raise ValueError('Unknown sample format %d' % sample_format)
+
+    # deinterleave frames into one row per channel
+    return Packet(channels, samples.reshape(-1, len(channels)).T, seq, timestamp, full_scale, window_start, vdda)
+
+
+class PacketTracker:
+    """Tracks the sequence numbers and timestamps of the packets of a logger.
+
+    Detects gaps (dropped samples), converts the wrapping device timestamps
+    into a continuous time (in seconds), estimates the real sample rate and
+    maps the device time to the host time so the data of several loggers
+    can be aligned.
+    """
+
+    def __init__(self):
+        self.num_gaps = 0
+        self.sample_rate = None
+        self._next_seq = None
+        self._last_timestamp = None
+        self._timestamp_base = 0
+        # reference point for rate estimation (time, number of frames since then)
+        self._ref_time = None
+        self._ref_frames = 0
+        # minimum of host time minus device time (i.e. with the lowest transfer latency)
+        self._host_offset = None
+
+    def add(self, packet, host_time):
+        """Adds a received packet.
+
+        `host_time` is the host time the packet was received at (e.g. `time.monotonic()`).
+        Returns the device time of the first frame (in seconds) and `True` if there
+        is a gap before this packet.
+        """
+        has_gap = self._next_seq is not None and packet.seq != self._next_seq
+        self._next_seq = (packet.seq + 1) & 0xffff
+
+        # extend 32-bit timestamp
+        if self._last_timestamp is not None and packet.timestamp < self._last_timestamp:
+            self._timestamp_base += 1 << 32
+        self._last_timestamp = packet.timestamp
+        time = (self._timestamp_base + packet.timestamp) * 1e-6
+
+        if has_gap:
+            self.num_gaps += 1
+        if has_gap or packet.window_start:
+            # the number of frames in between is unknown; restart rate estimation
+            self._ref_time = None
+
+        if self._ref_time is None:
+            self._ref_time = time
+            self._ref_frames = 0
+        elif time > self._ref_time:
+            self.sample_rate = self._ref_frames / (time - self._ref_time)
+        self._ref_frames += packet.samples.shape[1]
+
+        offset = host_time - time
+        if self._host_offset is None or offset < self._host_offset:
+            self._host_offset = offset
+
+        return time, has_gap
+
+    def device_time(self, timestamp):
+        """Converts a 32-bit device timestamp (in µs, close to the latest packet) into device time (in seconds)"""
+        delta = (timestamp - self._last_timestamp + (1 << 31)) % (1 << 32) - (1 << 31)
+        return (self._timestamp_base + self._last_timestamp + delta) * 1e-6
+
+    def host_time(self, device_time):
+        """Converts the device time (in seconds, as returned by `add()`) into host time"""
+        return device_time + self._host_offset
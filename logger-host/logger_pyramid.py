@@ -0,0 +1,142 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: min/max/mean pyramid for fast zoomed viewing
+#
+# Level k summarizes buckets of 2^(BASE_LOG2 + k) consecutive frames
+# with the minimum, maximum and sum of each channel. Level 0 is built
+# from the samples; each further level is built from pairs of buckets
+# of the level below. The pyramid is extended incrementally as samples
+# arrive.
+#
+
+import numpy as np
+
+BASE_LOG2 = 4
+NUM_LEVELS = 24
+
+
+class _Level:
+    """Buckets of a single level (arrays grow by doubling their capacity)"""
+
+    def __init__(self, num_channels):
+        self.size = 0
+        self.num_merged = 0  # number of buckets already merged into the next level
+        self.min = np.empty((num_channels, 16), dtype=np.uint16)
+        self.max = np.empty((num_channels, 16), dtype=np.uint16)
+        self.sum = np.empty((num_channels, 16), dtype=np.int64)
+
+    def append(self, mins, maxs, sums):
+        n = mins.shape[1]
+        if self.size + n > self.min.shape[1]:
+            capacity = max(2 * self.min.shape[1], self.size + n)
+            for name in ('min', 'max', 'sum'):
+                array = getattr(self, name)
+                grown = np.empty((array.shape[0], capacity), dtype=array.dtype)
+                grown[:, :self.size] = array[:, :self.size]
+                setattr(self, name, grown)
+        self.min[:, self.size:self.size + n] = mins
+        self.max[:, self.size:self.size + n] = maxs
+        self.sum[:, self.size:self.size + n] = sums
+        self.size += n
+
+
+class Pyramid:
+    """Min/max/mean pyramid of the samples of all channels"""
+
+    def __init__(self, num_channels):
+        self.num_channels = num_channels
+        self.num_frames = 0
+        self._pending = np.empty((num_channels, 0), dtype=np.uint16)
+        self._levels = [_Level(num_channels) for _ in range(NUM_LEVELS)]
+
+    def add(self, samples):
+        """Adds samples (2D array with a row per channel, e.g. `logger_packet.Packet.samples`)"""
+        self.num_frames += samples.shape[1]
+        data = np.concatenate((self._pending, samples), axis=1) if self._pending.shape[1] > 0 else samples
+        bucket = 1 << BASE_LOG2
+        n = data.shape[1] // bucket
+        self._pending = data[:, n * bucket:].astype(np.uint16)
+        if n == 0:
+            return
+
+        blocks = data[:, :n * bucket].reshape(self.num_channels, n, bucket)
+        self._append(0, blocks.min(axis=2), blocks.max(axis=2), blocks.sum(axis=2, dtype=np.int64))
+
+    def _append(self, k, mins, maxs, sums):
+        level = self._levels[k]
+        level.append(mins, maxs, sums)
+        if k + 1 == NUM_LEVELS:
+            return
+
+        # merge complete pairs of buckets into next level
+        num_pairs = (level.size - level.num_merged) // 2
+        if num_pairs == 0:
+            return
+        start = level.num_merged
+        end = start + 2 * num_pairs
+        level.num_merged = end
+        shape = (self.num_channels, num_pairs, 2)
+        self._append(k + 1,
+                     level.min[:, start:end].reshape(shape).min(axis=2),
+                     level.max[:, start:end].reshape(shape).max(axis=2),
+                     level.sum[:, start:end].reshape(shape).sum(axis=2))
+
+    def envelope(self, start, stop, width):
+        """Returns the envelope of the frames in the range [start, stop) for `width` pixels.
+
+        Returns the arrays min, max and mean, each with a row per channel and a column per pixel.
+        The level is selected so each pixel covers one or two buckets, i.e. the effort is O(width).
+        Frames not yet summarized in a complete bucket of the selected level are omitted, and the
+        resolution is limited to buckets of 2^BASE_LOG2 frames.
+        """
+        frames_per_pixel = max((stop - start) / width, 1)
+        k = min(max(int(np.log2(frames_per_pixel)) - BASE_LOG2, 0), NUM_LEVELS - 1)
+
+        # use a finer level if the selected level does not cover the range yet
+        while k > 0 and self._levels[k].size << (BASE_LOG2 + k) <= start:
+            k -= 1
+
+        level = self._levels[k]
+        log2_bucket = BASE_LOG2 + k
+        first = start >> log2_bucket
+        last = min(-(-stop >> log2_bucket), level.size)
+        if last <= first:
+            empty = np.empty((self.num_channels, 0))
+            return empty, empty, empty
+
+        # first bucket of each pixel (pixels might share a bucket if zoomed in closely)
+        edges = (np.arange(width) * (last - first)) // width
+        counts = np.diff(np.append(edges, last - first))
+        counts[counts == 0] = 1
+
+        mins = np.minimum.reduceat(level.min[:, first:last], edges, axis=1)
+        maxs = np.maximum.reduceat(level.max[:, first:last], edges, axis=1)
+        sums = np.add.reduceat(level.sum[:, first:last], edges, axis=1)
+        return mins, maxs, sums / (counts << log2_bucket)
+
+    def save(self, path):
+        """Saves the pyramid (e.g. alongside the capture file)"""
+        arrays = {'num_frames': self.num_frames, 'pending': self._pending}
+        for k, level in enumerate(self._levels):
+            arrays['min%d' % k] = level.min[:, :level.size]
+            arrays['max%d' % k] = level.max[:, :level.size]
+            arrays['sum%d' % k] = level.sum[:, :level.size]
+        np.savez(path, **arrays)
+
+    @staticmethod
+    def load(path):
+        """Loads a pyramid saved with `save()`"""
+        arrays = np.load(path)
+        pending = arrays['pending']
+        pyramid = Pyramid(pending.shape[0])
+        pyramid.num_frames = int(arrays['num_frames'])
+        pyramid._pending = pending
+        for k, level in enumerate(pyramid._levels):
+            level.append(arrays['min%d' % k], arrays['max%d' % k], arrays['sum%d' % k])
+            level.num_merged = level.size & ~1
+        return pyramid
@@ -0,0 +1,98 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: recorder (writes received packets to a capture file)
+#
+# Usage: python logger_recorder.py capture.bin [duration in seconds]
+#
+# The packets are not decoded while recording. A background thread
+# reads them from the endpoint and copies them into the memory-mapped
+# capture file. Analysis scripts can open the file with
+# `logger_capture.CaptureReader` while the recording is in progress.
+#
+# The main thread decodes the recorded packets to build a min/max/mean
+# pyramid for viewing, which is saved as capture.bin.pyramid.npz.
+#
+
+import sys
+import threading
+import time
+import usb.core
+import logger_capture
+import logger_device
+import logger_packet
+import logger_pyramid
+
+SAMPLE_RATE = 10000  # samples per second
+CHANNELS = [0]  # channel n is on pin PAn
+SAMPLE_FORMAT = logger_packet.FORMAT_DELTA_RICE  # or FORMAT_RAW16, FORMAT_PACKED12
+
+
+def record(logger, writer, stop_event):
+    """Reads packets and appends them to the capture file until stopped or the file is full"""
+    while not stop_event.is_set():
+        try:
+            packet = logger.read(100)
+        except usb.core.USBTimeoutError:
+            continue
+        if not writer.append(packet, time.monotonic()):
+            break
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: python logger_recorder.py capture.bin [duration]")
+        sys.exit(1)
+    path = sys.argv[1]
+    duration = float(sys.argv[2]) if len(sys.argv) > 2 else 60
+
+    # find device and configure it
+    logger = logger_device.Logger()
+    logger.configure(channels=CHANNELS, sample_rate=SAMPLE_RATE, sample_format=SAMPLE_FORMAT)
+    rate = logger.sample_rate
+
+    # preallocate for the worst case: a packet contains at least one frame,
+    # and the USB bandwidth limits the rate to about 19 packets per ms
+    capacity = int(duration * min(rate, 20000)) + 1000
+    writer = logger_capture.CaptureWriter(path, capacity, rate, logger_device.channel_mask(CHANNELS), time.monotonic())
+    print("Recording %0.0f s at %d samples/s to %s" % (duration, rate, path))
+
+    stop_event = threading.Event()
+    thread = threading.Thread(target=record, args=(logger, writer, stop_event))
+    thread.start()
+
+    reader = logger_capture.CaptureReader(path)
+    pyramid = logger_pyramid.Pyramid(len(CHANNELS))
+    num_summarized = 0
+
+    end_time = time.monotonic() + duration
+    try:
+        while thread.is_alive() and time.monotonic() < end_time:
+            time.sleep(1)
+            dropped = logger.counters().num_dropped_samples
+            print("%d packets, %d samples dropped" % (writer.num_packets, dropped))
+
+            # extend pyramid with the packets recorded in the meantime
+            num_packets = reader.num_packets
+            for packet in reader.decode(num_summarized, num_packets):
+                pyramid.add(packet.samples)
+            num_summarized = num_packets
+    except KeyboardInterrupt:
+        pass
+
+    stop_event.set()
+    thread.join()
+    writer.close()
+    print("%d packets recorded" % writer.num_packets)
+
+    for packet in reader.decode(num_summarized, reader.num_packets):
+        pyramid.add(packet.samples)
+    pyramid.save(path + '.pyramid.npz')
+
+
+if __name__ == '__main__':
+    main()
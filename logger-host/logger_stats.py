@@ -0,0 +1,122 @@
+#
+# USB Tutorial
+#
+# Copyright (c) 2020 Manuel Bleichenbacher
+# Licensed under MIT License
+# https://opensource.org/licenses/MIT
+#
+# Voltage logger: streaming statistics (per channel)
+#
+# Mean and variance are updated per batch of samples by merging
+# the batch's mean and variance (Welford/Chan algorithm), which is
+# numerically stable for long streams.
+#
+
+import queue
+import threading
+import numpy as np
+
+
+class StreamStats:
+    """Mean, variance, minimum, maximum, histogram and threshold crossings of each channel"""
+
+    def __init__(self, num_channels, threshold, value_range=4096, num_bins=64):
+        self.threshold = threshold
+        self.value_range = value_range
+        self.num_bins = num_bins
+        self.count = 0
+        self.mean = np.zeros(num_channels)
+        self.m2 = np.zeros(num_channels)
+        self.min = np.full(num_channels, value_range - 1)
+        self.max = np.zeros(num_channels, dtype=np.int64)
+        self.histogram = np.zeros((num_channels, num_bins), dtype=np.int64)
+        self.crossings = np.zeros(num_channels, dtype=np.int64)
+        self._above = None  # last sample of each channel at or above threshold
+
+    def add(self, samples):
+        """Adds samples (2D array with a row per channel, e.g. `logger_packet.Packet.samples`)"""
+        num_channels, n = samples.shape
+        if n == 0:
+            return
+
+        # merge mean and variance of batch
+        batch_mean = samples.mean(axis=1)
+        batch_m2 = ((samples - batch_mean[:, None]) ** 2).sum(axis=1)
+        total = self.count + n
+        delta = batch_mean - self.mean
+        self.mean += delta * n / total
+        self.m2 += batch_m2 + delta ** 2 * self.count * n / total
+        self.count = total
+
+        self.min = np.minimum(self.min, samples.min(axis=1))
+        self.max = np.maximum(self.max, samples.max(axis=1))
+
+        # histogram of all channels in a single pass (bins of channel c start at c * num_bins)
+        bins = samples.astype(np.int64) * self.num_bins // self.value_range
+        bins += np.arange(num_channels)[:, None] * self.num_bins
+        self.histogram += np.bincount(bins.ravel(), minlength=num_channels * self.num_bins) \
+            .reshape(num_channels, self.num_bins)
+
+        # threshold crossings (in either direction, including the one between batches)
+        above = samples >= self.threshold
+        if self._above is not None:
+            above = np.concatenate((self._above[:, None], above), axis=1)
+        self.crossings += np.count_nonzero(above[:, 1:] != above[:, :-1], axis=1)
+        self._above = above[:, -1]
+
+    @property
+    def variance(self):
+        """Sample variance of each channel"""
+        return self.m2 / max(self.count - 1, 1)
+
+    def crossing_rate(self, sample_rate):
+        """Threshold crossings per second of each channel"""
+        return self.crossings * sample_rate / max(self.count, 1)
+
+
+class StatsWorker:
+    """Computes the statistics in a worker thread.
+
+    The samples are handed over through a queue so the thread
+    reading from USB is not delayed by the computation.
+    """
+
+    def __init__(self, stats):
+        self._stats = stats
+        self._queue = queue.SimpleQueue()
+        self._lock = threading.Lock()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def add(self, samples):
+        """Queues samples for the statistics (returns immediately)"""
+        self._queue.put(samples)
+
+    def snapshot(self):
+        """Returns mean, standard deviation, minimum, maximum, histogram and crossings of each channel"""
+        with self._lock:
+            stats = self._stats
+            return (stats.mean.copy(), np.sqrt(stats.variance), stats.min.copy(), stats.max.copy(),
+                    stats.histogram.copy(), stats.crossings.copy())
+
+    def stop(self):
+        """Processes the queued samples and stops the worker thread"""
+        self._queue.put(None)
+        self._thread.join()
+
+    def _run(self):
+        while True:
+            samples = self._queue.get()
+            if samples is None:
+                break
+            # combine queued batches
+            batches = [samples]
+            while not self._queue.empty():
+                samples = self._queue.get()
+                if samples is None:
+                    self._queue.put(None)
+                    break
+                batches.append(samples)
+            data = np.concatenate(batches, axis=1) if len(batches) > 1 else batches[0]
+            with self._lock:
+                self._stats.add(data)
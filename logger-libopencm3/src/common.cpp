@@ -18,6 +18,20 @@ uint32_t millis()
     return millis_count;
 }
 
+uint32_t micros()
+{
+    // repeat if the SysTick interrupt occurred in between
+    uint32_t ms, ticks;
+    do
+    {
+        ms = millis_count;
+        ticks = systick_get_reload() - systick_get_value();
+    } while (ms != millis_count);
+
+    // SysTick counts down at 1/8 of the AHB frequency
+    return ms * 1000 + ticks / (rcc_ahb_frequency / 8 / 1000000);
+}
+
 void delay(uint32_t ms)
 {
     int32_t target_time = millis_count + ms;
@@ -25,6 +39,31 @@ void delay(uint32_t ms)
         ;
 }
 
+int count_channels(uint8_t mask)
+{
+    int n = 0;
+    for (int ch = 0; ch < 8; ch++)
+    {
+        if ((mask & (1 << ch)) != 0)
+            n++;
+    }
+    return n;
+}
+
+int channel_index(uint8_t mask, int channel)
+{
+    if (channel >= 8 || (mask & (1 << channel)) == 0)
+        return -1;
+
+    int index = 0;
+    for (int ch = 0; ch < channel; ch++)
+    {
+        if ((mask & (1 << ch)) != 0)
+            index++;
+    }
+    return index;
+}
+
 void systick_init()
 {
     // Initialize SysTick
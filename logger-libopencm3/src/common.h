@@ -25,10 +25,36 @@ void systick_init();
  */
 uint32_t millis();
 
+/**
+ * @brief Gets the time with microsecond resolution.
+ * 
+ * The value wraps around after about 71 minutes.
+ * 
+ * @return number of microseconds since a fixed time in the past
+ */
+uint32_t micros();
+
 /**
  * @brief Delays execution (busy wait)
  * @param ms delay length, in milliseconds
  */
 void delay(uint32_t ms);
 
+/**
+ * @brief Counts the channels in a channel mask.
+ *
+ * @param mask channel mask (bit n set if channel n is sampled)
+ * @return number of channels
+ */
+int count_channels(uint8_t mask);
+
+/**
+ * @brief Gets the index of a channel within a frame.
+ *
+ * @param mask channel mask (bit n set if channel n is sampled)
+ * @param channel channel number (0 to 7)
+ * @return index of the channel, or -1 if it is not sampled
+ */
+int channel_index(uint8_t mask, int channel);
+
 #endif
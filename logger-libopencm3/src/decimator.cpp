@@ -0,0 +1,59 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Decimation filter (boxcar average of oversampled ADC values)
+ *
+ * The filter is a first order CIC filter (integrate and dump). As the
+ * ratio is a power of 2, the scaling is a shift. Each doubling of the
+ * ratio adds half a bit of resolution for white noise (one bit if
+ * the signal has sufficient noise or dither).
+ */
+
+#include "decimator.h"
+
+void decimator_init(decimator *dec, int num_channels, int log2_ratio)
+{
+    dec->num_channels = num_channels;
+    dec->log2_ratio = log2_ratio;
+    dec->count = 0;
+    for (int ch = 0; ch < DECIMATOR_MAX_CHANNELS; ch++)
+        dec->sums[ch] = 0;
+}
+
+int decimator_process(decimator *dec, const uint16_t *in, int num_frames, uint16_t *out)
+{
+    const int num_channels = dec->num_channels;
+    const int log2_ratio = dec->log2_ratio;
+    const int ratio = 1 << log2_ratio;
+    int num_out = 0;
+
+    for (int i = 0; i < num_frames; i++)
+    {
+        for (int ch = 0; ch < num_channels; ch++)
+            dec->sums[ch] += in[ch];
+        in += num_channels;
+
+        if (++dec->count < ratio)
+            continue;
+
+        // sum has 12 + log2_ratio bits: scale to 16 bits (with rounding)
+        for (int ch = 0; ch < num_channels; ch++)
+        {
+            uint32_t sum = dec->sums[ch];
+            if (log2_ratio <= 4)
+                out[ch] = sum << (4 - log2_ratio);
+            else
+                out[ch] = (sum + (1 << (log2_ratio - 5))) >> (log2_ratio - 4);
+            dec->sums[ch] = 0;
+        }
+        out += num_channels;
+        num_out++;
+        dec->count = 0;
+    }
+
+    return num_out;
+}
@@ -0,0 +1,55 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Decimation filter (boxcar average of oversampled ADC values)
+ */
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stdint.h>
+
+// Maximum number of channels
+#define DECIMATOR_MAX_CHANNELS 8
+
+// Maximum decimation ratio is 2^DECIMATOR_MAX_LOG2_RATIO
+#define DECIMATOR_MAX_LOG2_RATIO 8
+
+// Decimator state
+struct decimator
+{
+    uint32_t sums[DECIMATOR_MAX_CHANNELS]; // sum of input samples of each channel
+    int num_channels;                      // number of channels per frame
+    int log2_ratio;                        // decimation ratio (as power of 2)
+    int count;                             // number of input frames summed up
+};
+
+/**
+ * @brief Initializes the decimator (discarding partially summed up frames).
+ *
+ * @param dec decimator
+ * @param num_channels number of channels per frame
+ * @param log2_ratio decimation ratio as power of 2 (0 to `DECIMATOR_MAX_LOG2_RATIO`)
+ */
+void decimator_init(decimator *dec, int num_channels, int log2_ratio);
+
+/**
+ * @brief Decimates the input frames.
+ *
+ * Each output frame is the average of 2^log2_ratio input frames.
+ * The output values are scaled from 12 to 16 bits (full scale: 4095 x 16).
+ * A partially summed up frame is completed with the next call.
+ *
+ * @param dec decimator
+ * @param in input samples (whole frames of 12-bit values)
+ * @param num_frames number of input frames
+ * @param out buffer for output samples (at least `num_frames / ratio + 1` frames)
+ * @return number of output frames
+ */
+int decimator_process(decimator *dec, const uint16_t *in, int num_frames, uint16_t *out);
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Sample encoder (fills packets of the transmit queue)
+ *
+ * Packets always contain whole frames (one sample of each channel).
+ */
+
+#include "encoder.h"
+#include "tx_queue.h"
+
+static constexpr int PAYLOAD_SIZE = TX_PACKET_SIZE - sizeof(packet_header);
+
+// maximum number of samples per packet, indexed by format
+static constexpr int MAX_SAMPLES[] = {
+    PAYLOAD_SIZE / 2,     // FORMAT_RAW16
+    PAYLOAD_SIZE * 2 / 3, // FORMAT_PACKED12
+    255,                  // FORMAT_DELTA_RICE (limited by header field)
+};
+
+static sample_format format = FORMAT_RAW16;
+static uint8_t channel_mask = 1;
+static int num_channels = 1;
+static bool is_16bit = false;
+static uint16_t vdda_mv = 3300;
+static uint16_t flush_timeout_ms = 0;
+static int max_samples = MAX_SAMPLES[FORMAT_RAW16];
+
+// packet being filled (or `nullptr`)
+static uint8_t *packet;
+static uint8_t *payload;
+static int num_samples_in_packet;
+static uint32_t packet_timestamp;
+
+// sequence number of next packet
+static uint16_t packet_seq;
+// indicates if samples have been dropped since the last packet
+static bool has_dropped_samples;
+// indicates if the next packet starts a captured window
+static bool is_window_start;
+
+// bit stream writer (delta format)
+struct bit_writer
+{
+    uint8_t *out;  // next byte of bit stream
+    uint32_t acc;  // bits not yet written to bit stream
+    int count;     // number of bits in `acc`
+    int num_bits;  // number of bits in bit stream
+    uint32_t sum_zz; // sum of zig-zag encoded deltas in current packet
+};
+
+// delta format state
+static int rice_k;                                   // Rice parameter of current packet
+static int delta_prefix_size;                        // Rice parameter and key frame
+static int delta_max_bits;                           // maximum size of bit stream
+static uint16_t prev_samples[ENCODER_MAX_CHANNELS]; // previous sample of each channel
+static bit_writer bits;
+
+// Appends bits to the bit stream (LSB first)
+static void put_bits(uint32_t value, int len)
+{
+    bits.acc |= value << bits.count;
+    bits.count += len;
+    bits.num_bits += len;
+    while (bits.count >= 8)
+    {
+        *bits.out++ = bits.acc;
+        bits.acc >>= 8;
+        bits.count -= 8;
+    }
+}
+
+// Returns the payload length for the given number of samples
+static int payload_len(int num_samples)
+{
+    if (format == FORMAT_PACKED12)
+        return (num_samples * 3 + 1) / 2;
+    if (format == FORMAT_DELTA_RICE)
+        return delta_prefix_size + (bits.num_bits + 7) / 8;
+    return num_samples * 2;
+}
+
+// Adds the current packet to the transmit queue
+static void commit_packet()
+{
+    if (format == FORMAT_DELTA_RICE)
+    {
+        // write remaining bits
+        if (bits.count > 0)
+            *bits.out = bits.acc;
+
+        // choose Rice parameter for next packet from mean of current packet
+        int num_deltas = num_samples_in_packet - num_channels;
+        if (num_deltas > 0)
+        {
+            uint32_t mean = bits.sum_zz / num_deltas;
+            int k = 0;
+            while (k < RICE_MAX_K && (2U << k) <= mean)
+                k++;
+            rice_k = k;
+        }
+    }
+
+    packet_header *header = reinterpret_cast<packet_header *>(packet);
+    uint8_t flags = is_window_start ? FORMAT_FLAG_WINDOW_START : 0;
+    if (is_16bit && format != FORMAT_PACKED12)
+        flags |= FORMAT_FLAG_16BIT;
+    header->format = format | flags;
+    header->channels = channel_mask;
+    header->num_samples = num_samples_in_packet;
+    header->seq = packet_seq++;
+    header->timestamp = packet_timestamp;
+    header->vdda = vdda_mv;
+    is_window_start = false;
+    tx_queue_commit(sizeof(packet_header) + payload_len(num_samples_in_packet));
+    packet = nullptr;
+}
+
+// Adds the current packet to the transmit queue if it contains samples
+static void flush_packet()
+{
+    if (packet != nullptr && num_samples_in_packet > 0)
+        commit_packet();
+}
+
+// Updates the parameters derived from format and channels
+static void update_layout()
+{
+    max_samples = (MAX_SAMPLES[format] / num_channels) * num_channels;
+    delta_prefix_size = 1 + 2 * num_channels;
+    delta_max_bits = (PAYLOAD_SIZE - delta_prefix_size) * 8;
+    rice_k = 0;
+}
+
+// Adds a frame in delta format. Returns `false` if it does not fit into the packet.
+static bool add_delta_frame(const uint16_t *frame)
+{
+    if (num_samples_in_packet == 0)
+    {
+        // key frame
+        payload[0] = rice_k;
+        for (int ch = 0; ch < num_channels; ch++)
+        {
+            uint16_t sample = frame[ch];
+            payload[1 + 2 * ch] = sample;
+            payload[2 + 2 * ch] = sample >> 8;
+            prev_samples[ch] = sample;
+        }
+        bits.out = payload + delta_prefix_size;
+        bits.acc = 0;
+        bits.count = 0;
+        bits.num_bits = 0;
+        bits.sum_zz = 0;
+        return true;
+    }
+
+    // state to restore if frame does not fit
+    bit_writer saved_bits = bits;
+
+    for (int ch = 0; ch < num_channels; ch++)
+    {
+        // zig-zag encoding of delta (0, -1, 1, -2, 2, ... => 0, 1, 2, 3, 4, ...)
+        int32_t delta = (int32_t)frame[ch] - (int32_t)prev_samples[ch];
+        uint32_t zz = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+        // Rice code: quotient in unary (ones terminated by zero), remainder in k bits;
+        // large values are escaped (RICE_ESCAPE ones followed by the value)
+        uint32_t q = zz >> rice_k;
+        int len = q < RICE_ESCAPE ? (int)q + 1 + rice_k : RICE_ESCAPE + RICE_ESCAPE_BITS;
+        if (bits.num_bits + len > delta_max_bits)
+        {
+            bits = saved_bits;
+            return false;
+        }
+
+        if (q < RICE_ESCAPE)
+        {
+            put_bits((1U << q) - 1, q + 1);
+            put_bits(zz & ((1U << rice_k) - 1), rice_k);
+        }
+        else
+        {
+            put_bits((1U << RICE_ESCAPE) - 1, RICE_ESCAPE);
+            put_bits(zz, RICE_ESCAPE_BITS);
+        }
+
+        bits.sum_zz += zz;
+    }
+
+    for (int ch = 0; ch < num_channels; ch++)
+        prev_samples[ch] = frame[ch];
+    return true;
+}
+
+// Adds a frame. Returns `false` if it does not fit into the packet.
+static bool add_frame(const uint16_t *frame)
+{
+    if (format == FORMAT_DELTA_RICE)
+        return add_delta_frame(frame);
+
+    for (int ch = 0; ch < num_channels; ch++)
+    {
+        uint16_t sample = frame[ch];
+        int n = num_samples_in_packet + ch;
+
+        if (format == FORMAT_PACKED12)
+        {
+            if (is_16bit)
+                sample >>= 4;
+            uint8_t *p = payload + (n >> 1) * 3;
+            if ((n & 1) == 0)
+            {
+                p[0] = sample;
+                p[1] = sample >> 8;
+            }
+            else
+            {
+                p[1] |= sample << 4;
+                p[2] = sample >> 4;
+            }
+        }
+        else
+        {
+            payload[2 * n] = sample;
+            payload[2 * n + 1] = sample >> 8;
+        }
+    }
+
+    return true;
+}
+
+bool encoder_set_format(uint8_t fmt)
+{
+    if (fmt != FORMAT_RAW16 && fmt != FORMAT_PACKED12 && fmt != FORMAT_DELTA_RICE)
+        return false;
+
+    flush_packet();
+    format = static_cast<sample_format>(fmt);
+    update_layout();
+    return true;
+}
+
+sample_format encoder_get_format()
+{
+    return format;
+}
+
+void encoder_set_channels(uint8_t mask)
+{
+    flush_packet();
+
+    channel_mask = mask;
+    num_channels = 0;
+    for (int ch = 0; ch < ENCODER_MAX_CHANNELS; ch++)
+    {
+        if ((mask & (1 << ch)) != 0)
+            num_channels++;
+    }
+
+    update_layout();
+}
+
+void encoder_set_16bit(bool enabled)
+{
+    flush_packet();
+    is_16bit = enabled;
+    update_layout();
+}
+
+void encoder_set_vdda(uint16_t vdda)
+{
+    vdda_mv = vdda;
+}
+
+void encoder_set_flush_timeout(uint16_t timeout)
+{
+    flush_timeout_ms = timeout;
+}
+
+uint16_t encoder_get_flush_timeout()
+{
+    return flush_timeout_ms;
+}
+
+void encoder_check_timeout(uint32_t now)
+{
+    if (flush_timeout_ms != 0 && packet != nullptr && num_samples_in_packet > 0
+        && now - packet_timestamp >= flush_timeout_ms * 1000U)
+        commit_packet();
+}
+
+int encoder_add_samples(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period)
+{
+    for (int i = 0; i < num_samples; i += num_channels)
+    {
+        if (packet == nullptr)
+        {
+            packet = tx_queue_alloc();
+            if (packet == nullptr)
+                return num_samples - i; // transmit queue is full
+            payload = packet + sizeof(packet_header);
+            num_samples_in_packet = 0;
+
+            // skip a sequence number to indicate the gap
+            if (has_dropped_samples)
+            {
+                packet_seq++;
+                has_dropped_samples = false;
+            }
+        }
+
+        if (num_samples_in_packet == 0)
+            packet_timestamp = timestamp + (uint32_t)((uint64_t)(i / num_channels) * frame_period / 1000);
+
+        if (!add_frame(samples + i))
+        {
+            // packet is full; retry frame with next packet
+            commit_packet();
+            i -= num_channels;
+            continue;
+        }
+
+        num_samples_in_packet += num_channels;
+        if (num_samples_in_packet + num_channels > max_samples)
+            commit_packet();
+    }
+
+    return 0;
+}
+
+void encoder_mark_gap()
+{
+    has_dropped_samples = true;
+}
+
+void encoder_mark_window_start()
+{
+    flush_packet();
+    is_window_start = true;
+}
+
+void encoder_flush()
+{
+    flush_packet();
+}
+
+void encoder_reset()
+{
+    packet = nullptr;
+    rice_k = 0;
+    packet_seq = 0;
+    has_dropped_samples = false;
+    is_window_start = false;
+}
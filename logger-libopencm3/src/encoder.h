@@ -0,0 +1,174 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Sample encoder (fills packets of the transmit queue)
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+// Maximum number of channels
+#define ENCODER_MAX_CHANNELS 8
+
+// Sample format
+enum sample_format : uint8_t
+{
+    // 16-bit values (little endian)
+    FORMAT_RAW16 = 0,
+    // 12-bit values, two samples packed in 3 bytes:
+    // byte 0: bits 0-7 of sample 0
+    // byte 1: bits 8-11 of sample 0 (low nibble), bits 0-3 of sample 1 (high nibble)
+    // byte 2: bits 4-11 of sample 1
+    FORMAT_PACKED12 = 1,
+    // Delta compression, each packet can be decoded on its own:
+    // byte 0: Rice parameter k
+    // bytes 1-: first frame (16-bit values, little endian)
+    // followed by: bit stream (LSB first) with a Rice code for each further sample:
+    // the zig-zag encoded delta to the previous sample of the same channel is split into a quotient
+    // (delta >> k, as unary code of ones terminated by a zero) and k remainder bits.
+    // Quotients of `RICE_ESCAPE` or more are sent as `RICE_ESCAPE` ones followed by
+    // the zig-zag encoded delta in `RICE_ESCAPE_BITS` bits.
+    FORMAT_DELTA_RICE = 2,
+};
+
+// Flag in format byte of packet header: the samples are 16-bit values (full scale: 4095 x 16)
+// instead of 12-bit values (not used with `FORMAT_PACKED12`)
+#define FORMAT_FLAG_16BIT 0x80
+
+// Flag in format byte of packet header: the packet is the first one of a captured window
+// (triggered capture)
+#define FORMAT_FLAG_WINDOW_START 0x40
+
+// Unary prefix length indicating an escaped value (delta format)
+#define RICE_ESCAPE 15
+// Number of bits of escaped value (delta format)
+#define RICE_ESCAPE_BITS 17
+// Maximum Rice parameter (delta format)
+#define RICE_MAX_K 14
+
+// Header at the start of each packet.
+// The samples of all channels are interleaved, i.e. the packet contains
+// frames consisting of one sample of each channel (in ascending order).
+// The sequence number is incremented with each packet. It skips a number
+// if samples have been dropped before the packet.
+struct packet_header
+{
+    uint8_t format;      // sample format (see `sample_format`) and flags
+    uint8_t channels;    // channels (bit n set if channel n is included)
+    uint8_t num_samples; // number of samples in packet (all channels)
+    uint16_t seq;        // sequence number
+    uint32_t timestamp;  // time of first frame (in µs, wraps around)
+    uint16_t vdda;       // supply voltage VDDA, corresponding to the full scale value (in mV)
+} __attribute__((packed));
+
+/**
+ * @brief Sets the sample format.
+ *
+ * A partially filled packet is added to the transmit queue first.
+ *
+ * @param format sample format
+ * @return `true` if successful, `false` if the format is invalid
+ */
+bool encoder_set_format(uint8_t format);
+
+/**
+ * @brief Gets the sample format.
+ *
+ * @return sample format
+ */
+sample_format encoder_get_format();
+
+/**
+ * @brief Sets the channels contained in each frame.
+ *
+ * A partially filled packet is added to the transmit queue first.
+ *
+ * @param mask channel mask (bit n set if channel n is included)
+ */
+void encoder_set_channels(uint8_t mask);
+
+/**
+ * @brief Sets the resolution of the samples.
+ *
+ * With `FORMAT_PACKED12`, 16-bit samples are reduced to 12 bits.
+ * A partially filled packet is added to the transmit queue first.
+ *
+ * @param enabled `true` for 16-bit samples, `false` for 12-bit samples
+ */
+void encoder_set_16bit(bool enabled);
+
+/**
+ * @brief Sets the supply voltage reported in the packet header.
+ *
+ * @param vdda supply voltage VDDA (in mV)
+ */
+void encoder_set_vdda(uint16_t vdda);
+
+/**
+ * @brief Sets the flush timeout (packet fill policy).
+ *
+ * If the timeout is set, a partially filled packet is added to the
+ * transmit queue when its first frame is older than the timeout
+ * (see `encoder_check_timeout()`). Otherwise, packets are only
+ * added when they are full.
+ *
+ * @param timeout timeout (in ms, 0 to only add full packets)
+ */
+void encoder_set_flush_timeout(uint16_t timeout);
+
+/**
+ * @brief Gets the flush timeout.
+ *
+ * @return timeout (in ms, 0 if only full packets are added)
+ */
+uint16_t encoder_get_flush_timeout();
+
+/**
+ * @brief Adds the partially filled packet to the transmit queue if the flush timeout has expired.
+ *
+ * @param now current time (in µs, see `micros()`)
+ */
+void encoder_check_timeout(uint32_t now);
+
+/**
+ * @brief Adds samples to the packets in the transmit queue.
+ *
+ * Full packets are added to the transmit queue. If the transmit
+ * queue is full, the remaining samples are not added.
+ *
+ * @param samples array of samples (whole frames)
+ * @param num_samples number of samples
+ * @param timestamp time of the first frame (in µs)
+ * @param frame_period time between two frames (in ns)
+ * @return number of samples not added (whole frames)
+ */
+int encoder_add_samples(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period);
+
+/**
+ * @brief Indicates that samples have been dropped.
+ *
+ * The sequence number of the next packet will skip a value.
+ */
+void encoder_mark_gap();
+
+/**
+ * @brief Indicates that the next samples start a captured window.
+ *
+ * A partially filled packet is added to the transmit queue first.
+ * The next packet is marked with `FORMAT_FLAG_WINDOW_START`.
+ */
+void encoder_mark_window_start();
+
+/// Adds a partially filled packet to the transmit queue
+void encoder_flush();
+
+/// Resets the encoder (discarding a partially filled packet and restarting the sequence numbers)
+void encoder_reset();
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Events (alarms, overruns, trigger) for the interrupt endpoint
+ *
+ * Events are queued separately from the sample packets so they do
+ * not wait behind queued data. The queue is a circular buffer of
+ * event records. Events are added by the DMA interrupt handler and
+ * removed by the USB interrupt handler, which have the same priority
+ * and thus do not interrupt each other.
+ */
+
+#include "events.h"
+#include "common.h"
+#include <string.h>
+
+static constexpr int QUEUE_SIZE = EVENT_QUEUE_LEN + 1;
+
+// head == tail: queue is empty
+static int queue_head = 0; // updated when adding events
+static int queue_tail = 0; // updated when removing events
+static event_record queue[QUEUE_SIZE];
+
+static alarm_config alarm = {ALARM_OFF, 0, 2048, 16};
+static uint8_t channel_mask = 1;
+static int num_channels = 1;
+static int alarm_index = 0;       // index of alarm channel within frame
+static bool has_alarm_state;      // indicates if `is_above` is valid
+static bool is_above;             // alarm channel is at or above the level
+
+static int next_index(int index)
+{
+    index++;
+    return index < QUEUE_SIZE ? index : 0;
+}
+
+bool events_set_alarm(const alarm_config *config)
+{
+    if (config->mode > ALARM_BOTH)
+        return false;
+    if (config->mode != ALARM_OFF && channel_index(channel_mask, config->channel) < 0)
+        return false;
+
+    alarm = *config;
+    events_set_channels(channel_mask);
+    return true;
+}
+
+const alarm_config *events_get_alarm()
+{
+    return &alarm;
+}
+
+void events_set_channels(uint8_t mask)
+{
+    channel_mask = mask;
+    num_channels = count_channels(mask);
+    alarm_index = channel_index(mask, alarm.channel);
+    if (alarm_index < 0)
+    {
+        alarm.mode = ALARM_OFF;
+        alarm_index = 0;
+    }
+    has_alarm_state = false;
+}
+
+void events_check_alarm(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period)
+{
+    if (alarm.mode == ALARM_OFF)
+        return;
+
+    int num_frames = num_samples / num_channels;
+    int low_level = (int)alarm.level - alarm.hysteresis;
+    for (int i = 0; i < num_frames; i++)
+    {
+        uint16_t value = samples[i * num_channels + alarm_index];
+
+        if (!has_alarm_state)
+        {
+            // initial state (not reported)
+            is_above = value >= alarm.level;
+            has_alarm_state = true;
+        }
+        else if (!is_above && value >= alarm.level)
+        {
+            is_above = true;
+            if ((alarm.mode & ALARM_RISING) != 0)
+                events_add(EVENT_ALARM_RISING, alarm.channel, value,
+                           timestamp + (uint32_t)((uint64_t)i * frame_period / 1000));
+        }
+        else if (is_above && value < low_level)
+        {
+            is_above = false;
+            if ((alarm.mode & ALARM_FALLING) != 0)
+                events_add(EVENT_ALARM_FALLING, alarm.channel, value,
+                           timestamp + (uint32_t)((uint64_t)i * frame_period / 1000));
+        }
+    }
+}
+
+void events_add(event_type type, uint8_t channel, uint16_t value, uint32_t timestamp)
+{
+    int head = queue_head;
+    if (next_index(head) == queue_tail)
+        return;
+
+    event_record *event = &queue[head];
+    event->type = type;
+    event->channel = channel;
+    event->value = value;
+    event->timestamp = timestamp;
+    queue_head = next_index(head);
+}
+
+int events_take(uint8_t *buf, int len)
+{
+    int size = 0;
+    while (queue_tail != queue_head && size + (int)sizeof(event_record) <= len)
+    {
+        memcpy(buf + size, &queue[queue_tail], sizeof(event_record));
+        size += sizeof(event_record);
+        queue_tail = next_index(queue_tail);
+    }
+    return size;
+}
+
+void events_reset()
+{
+    queue_head = 0;
+    queue_tail = 0;
+    has_alarm_state = false;
+}
@@ -0,0 +1,123 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Events (alarms, overruns, trigger) for the interrupt endpoint
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+// Number of events that fit into the queue
+#define EVENT_QUEUE_LEN 32
+
+// Event type
+enum event_type : uint8_t
+{
+    // value has risen to or above the alarm level (value: sample)
+    EVENT_ALARM_RISING = 1,
+    // value has fallen below the alarm level minus hysteresis (value: sample)
+    EVENT_ALARM_FALLING = 2,
+    // samples are being dropped as the transmit queue is full or the DMA buffer has overrun
+    // (value: number of dropped samples, saturated)
+    EVENT_OVERRUN = 3,
+    // trigger has fired (value: sample)
+    EVENT_TRIGGER = 4,
+};
+
+// Event record (as transmitted on the interrupt endpoint)
+struct event_record
+{
+    uint8_t type;       // event type (see `event_type`)
+    uint8_t channel;    // channel the event relates to (0 if not applicable)
+    uint16_t value;     // event specific value
+    uint32_t timestamp; // time of the event (in µs, wraps around, same time base as packets)
+} __attribute__((packed));
+
+// Alarm mode (bit flags)
+enum alarm_mode : uint8_t
+{
+    ALARM_OFF = 0,
+    // report when the value rises to or above the level
+    ALARM_RISING = 1,
+    // report when the value falls below the level minus the hysteresis
+    ALARM_FALLING = 2,
+    // report both
+    ALARM_BOTH = 3,
+};
+
+// Alarm configuration
+struct alarm_config
+{
+    uint8_t mode;        // alarm mode (see `alarm_mode`)
+    uint8_t channel;     // channel the alarm applies to (0 to 7)
+    uint16_t level;      // alarm level (in sample units)
+    uint16_t hysteresis; // hysteresis below the level (in sample units)
+} __attribute__((packed));
+
+/**
+ * @brief Sets the alarm configuration.
+ *
+ * The alarm channel must be one of the sampled channels.
+ *
+ * @param config alarm configuration
+ * @return `true` if successful, `false` if the configuration is invalid
+ */
+bool events_set_alarm(const alarm_config *config);
+
+/**
+ * @brief Gets the alarm configuration.
+ *
+ * @return alarm configuration
+ */
+const alarm_config *events_get_alarm();
+
+/**
+ * @brief Sets the sampled channels.
+ *
+ * If the alarm channel is no longer sampled, the alarm is disabled.
+ *
+ * @param mask channel mask (bit n set if channel n is sampled)
+ */
+void events_set_channels(uint8_t mask);
+
+/**
+ * @brief Checks the samples for alarm level crossings.
+ *
+ * @param samples array of samples (whole frames)
+ * @param num_samples number of samples
+ * @param timestamp time of the first frame (in µs)
+ * @param frame_period time between two frames (in ns)
+ */
+void events_check_alarm(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period);
+
+/**
+ * @brief Adds an event to the queue.
+ *
+ * If the queue is full, the event is dropped.
+ *
+ * @param type event type
+ * @param channel channel the event relates to
+ * @param value event specific value
+ * @param timestamp time of the event (in µs)
+ */
+void events_add(event_type type, uint8_t channel, uint16_t value, uint32_t timestamp);
+
+/**
+ * @brief Removes the oldest events from the queue and copies them to the buffer.
+ *
+ * @param buf buffer for the event records
+ * @param len length of the buffer (in bytes)
+ * @return number of bytes copied (0 if the queue is empty)
+ */
+int events_take(uint8_t *buf, int len);
+
+/// Resets (empties) the queue and resets the alarm state
+void events_reset();
+
+#endif
@@ -9,21 +9,65 @@
  */
 
 #include "common.h"
+#include "encoder.h"
+#include "events.h"
+#include "sampler.h"
+#include "trigger.h"
+#include "tx_queue.h"
 #include "usb_descriptor.h"
-#include <libopencm3/stm32/adc.h>
+#include "usb_iso_ep.h"
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/usb/usbd.h>
+#include <string.h>
+#include <algorithm>
+
+static_assert(TX_PACKET_SIZE == BULK_MAX_PACKET_SIZE, "packet size must match endpoint size");
+static_assert(ALTSETTING_ISO_HIGH == ISO_MAX_PACKETS_PER_FRAME, "alternate setting must match packets per frame");
 
-#define SAMPLES_PER_MESSAGE 10
 static void usb_set_config(usbd_device *usbd_dev, uint16_t wValue);
+static void usb_set_altsetting(usbd_device *usbd_dev, uint16_t wIndex, uint16_t wValue);
 static void usb_data_transmitted(usbd_device *usbd_dev, uint8_t ep);
+static void usb_event_transmitted(usbd_device *usbd_dev, uint8_t ep);
+static usbd_request_return_codes logger_control(usbd_device *usbd_dev, usb_setup_data *req,
+                                                uint8_t **buf, uint16_t *len,
+                                                usbd_control_complete_callback *complete);
+static void samples_ready(const uint16_t *samples, int num_samples, uint32_t timestamp);
+static void samples_dropped(int num_samples, uint32_t timestamp);
+static void usb_start_tx();
+static void usb_iso_fill();
+static void usb_start_event_tx();
+
+// Counters (reported to the host)
+struct logger_counters
+{
+    uint32_t num_samples;         // number of samples taken
+    uint32_t num_dropped_samples; // number of samples dropped as the transmit queue was full or the DMA overran
+    uint32_t num_triggers;        // number of captured windows (triggered capture)
+};
+
+// Active configuration (reported to the host)
+struct logger_config
+{
+    uint32_t sample_rate;   // sample rate (in samples per second, after decimation)
+    uint8_t channels;       // channel mask (bit n set if channel n is sampled)
+    uint8_t format;         // sample format (see `sample_format`)
+    uint8_t mode;           // sampling mode (see `sampler_mode`)
+    uint16_t decimation;    // decimation ratio
+    uint16_t flush_timeout; // flush timeout (in ms, 0 if only full packets are transmitted)
+    uint16_t vdda;          // measured supply voltage (in mV)
+    trigger_config trigger; // trigger configuration
+    alarm_config alarm;     // alarm configuration
+} __attribute__((packed));
 
 usbd_device *usb_device;
 uint8_t usbd_control_buffer[256];
-int num_samples = 0;
-uint16_t samples[SAMPLES_PER_MESSAGE];
 bool is_configured = false;
+bool is_tx_busy = false;
+int iso_packets_per_frame = 0; // data packets per isochronous packet (0 if the bulk endpoint is used)
+bool is_event_tx_busy = false;
+bool is_overrun = false; // samples are being dropped
+logger_counters counters;
 
 void init()
 {
@@ -48,6 +92,8 @@ void usb_init()
     gpio_clear(GPIOA, GPIO12);
     delay(80);
 
+    usb_init_string_descs();
+
     // create USB device
     usb_device = usbd_init(&st_usbfs_v1_usb_driver, &usb_device_desc, usb_config_desc,
                            usb_desc_strings, sizeof(usb_desc_strings) / sizeof(usb_desc_strings[0]),
@@ -55,6 +101,7 @@ void usb_init()
 
     // Set callback for config calls
     usbd_register_set_config_callback(usb_device, usb_set_config);
+    usbd_register_set_altsetting_callback(usb_device, usb_set_altsetting);
     register_wcid_desc(usb_device);
 
     // Enable interrupt
@@ -62,81 +109,443 @@ void usb_init()
     nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
 }
 
-void adc_init()
+// Called when the host connects to the device and selects a configuration
+void usb_set_config(usbd_device *usbd_dev, uint16_t wValue)
 {
-    rcc_periph_clock_enable(RCC_ADC1);
-    adc_power_off(ADC1);
+    // the data endpoint is set up last as the isochronous mode uses the top of the packet memory
+    usbd_ep_setup(usbd_dev, EP_EVENT_IN, USB_ENDPOINT_ATTR_INTERRUPT, INTR_MAX_PACKET_SIZE, usb_event_transmitted);
+    usbd_ep_setup(usbd_dev, EP_DATA_IN, USB_ENDPOINT_ATTR_BULK, BULK_MAX_PACKET_SIZE, usb_data_transmitted);
+    encoder_reset();
+    trigger_reset();
+    events_reset();
+    tx_queue_reset();
+    is_tx_busy = false;
+    is_event_tx_busy = false;
+    is_overrun = false;
+    iso_packets_per_frame = 0;
+    register_wcid_desc(usb_device);
+    usbd_register_control_callback(usbd_dev,
+                                   USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_INTERFACE,
+                                   USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+                                   logger_control);
+    is_configured = wValue != 0;
+}
 
-    // configure for regular single conversion
-    adc_disable_scan_mode(ADC1);
-    adc_set_single_conversion_mode(ADC1);
-    adc_disable_external_trigger_regular(ADC1);
-    adc_set_right_aligned(ADC1);
+// Called when the host selects an alternate setting of the interface
+void usb_set_altsetting(__attribute__((unused)) usbd_device *usbd_dev, uint16_t wIndex, uint16_t wValue)
+{
+    if (wIndex != INTF_COMM)
+        return;
 
-    // power up
-    adc_power_on(ADC1);
-    delay(100);
-    adc_reset_calibration(ADC1);
-    adc_calibrate(ADC1);
+    // A packet written to the bulk endpoint but not collected is still
+    // in the transmit queue and will be transmitted again.
+    is_tx_busy = false;
 
-    // configure A0 as ADC channel
-    gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG, 0);
-    uint8_t channels[] = {ADC_CHANNEL0};
-    adc_set_regular_sequence(ADC1, 1, channels);
+    if (wValue == ALTSETTING_BULK)
+    {
+        if (iso_packets_per_frame > 0)
+            usb_iso_ep_reset(EP_DATA_IN);
+        iso_packets_per_frame = 0;
+        usb_start_tx();
+    }
+    else
+    {
+        if (iso_packets_per_frame == 0)
+            usb_iso_ep_setup(EP_DATA_IN, ISO_PACKET_SIZE(ISO_MAX_PACKETS_PER_FRAME));
+        iso_packets_per_frame = wValue;
+        usb_iso_fill();
+    }
 }
 
-// Called when the host connects to the device and selects a configuration
-void usb_set_config(usbd_device *usbd_dev, uint16_t wValue)
+// Called when a vendor request has been received
+usbd_request_return_codes logger_control(__attribute__((unused)) usbd_device *usbd_dev, usb_setup_data *req,
+                                         uint8_t **buf, uint16_t *len,
+                                         __attribute__((unused)) usbd_control_complete_callback *complete)
 {
-    usbd_ep_setup(usbd_dev, EP_DATA_IN, USB_ENDPOINT_ATTR_BULK, BULK_MAX_PACKET_SIZE, usb_data_transmitted);
-    register_wcid_desc(usb_device);
-    is_configured = wValue != 0;
+    // The expected request format is (bmRequestType is filtered by callback registration):
+    // bmRequestType = 0x41 to set the sample rate (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the sample rate (data direction: device to host)
+    // bmRequest: 0x40 (sample rate request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data: sample rate in samples per second (32-bit unsigned integer, little endian)
+    if (req->bRequest == SAMPLE_RATE_ID && req->wIndex == INTF_COMM)
+    {
+        uint32_t rate;
+
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            rate = sampler_get_rate();
+            *len = std::min(*len, (uint16_t)sizeof(rate));
+            memcpy(*buf, &rate, *len);
+            return USBD_REQ_HANDLED;
+        }
+
+        if (*len != sizeof(rate))
+            return USBD_REQ_NOTSUPP;
+
+        memcpy(&rate, *buf, sizeof(rate));
+        return sampler_set_rate(rate) ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Sample format request:
+    // bmRequestType = 0x41 to set the format (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the format (data direction: device to host, 1 byte)
+    // bmRequest: 0x42 (sample format request)
+    // wValue: sample format (see `sample_format`)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == FORMAT_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            (*buf)[0] = encoder_get_format();
+            *len = std::min(*len, (uint16_t)1);
+            return USBD_REQ_HANDLED;
+        }
+
+        if (!encoder_set_format(req->wValue))
+            return USBD_REQ_NOTSUPP;
+
+        usb_start_tx();
+        return USBD_REQ_HANDLED;
+    }
+
+    // Channels request:
+    // bmRequestType = 0x41 to set the channels (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the channels (data direction: device to host, 1 byte)
+    // bmRequest: 0x43 (channels request)
+    // wValue: channel mask (bit n set to sample channel n on pin PAn)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == CHANNELS_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            (*buf)[0] = sampler_get_channels();
+            *len = std::min(*len, (uint16_t)1);
+            return USBD_REQ_HANDLED;
+        }
+
+        if (req->wValue > 0xff || !sampler_set_channels(req->wValue))
+            return USBD_REQ_NOTSUPP;
+
+        encoder_set_channels(req->wValue);
+        trigger_set_channels(req->wValue);
+        events_set_channels(req->wValue);
+        usb_start_tx();
+        return USBD_REQ_HANDLED;
+    }
+
+    // Sampling mode request:
+    // bmRequestType = 0x41 to set the mode (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the mode (data direction: device to host, 1 byte)
+    // bmRequest: 0x44 (sampling mode request)
+    // wValue: sampling mode (see `sampler_mode`)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == MODE_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            (*buf)[0] = sampler_get_mode();
+            *len = std::min(*len, (uint16_t)1);
+            return USBD_REQ_HANDLED;
+        }
+
+        return sampler_set_mode(req->wValue) ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Decimation request:
+    // bmRequestType = 0x41 to set the ratio (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the ratio (data direction: device to host, 2 bytes)
+    // bmRequest: 0x45 (decimation request)
+    // wValue: decimation ratio (1, 2, 4, ... 256; 1 to disable decimation)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == DECIMATION_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            uint16_t ratio = sampler_get_decimation();
+            *len = std::min(*len, (uint16_t)sizeof(ratio));
+            memcpy(*buf, &ratio, *len);
+            return USBD_REQ_HANDLED;
+        }
+
+        if (!sampler_set_decimation(req->wValue))
+            return USBD_REQ_NOTSUPP;
+
+        encoder_set_16bit(req->wValue > 1);
+        usb_start_tx();
+        return USBD_REQ_HANDLED;
+    }
+
+    // Trigger request:
+    // bmRequestType = 0x41 to set the trigger (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the trigger (data direction: device to host)
+    // bmRequest: 0x46 (trigger request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data: trigger configuration (see `trigger_config`, little endian)
+    if (req->bRequest == TRIGGER_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            *len = std::min(*len, (uint16_t)sizeof(trigger_config));
+            memcpy(*buf, trigger_get_config(), *len);
+            return USBD_REQ_HANDLED;
+        }
+
+        trigger_config config;
+        if (*len != sizeof(config))
+            return USBD_REQ_NOTSUPP;
+
+        memcpy(&config, *buf, sizeof(config));
+        if (!trigger_set_config(&config))
+            return USBD_REQ_NOTSUPP;
+
+        // start a new packet for streamed or captured samples
+        encoder_flush();
+        usb_start_tx();
+        return USBD_REQ_HANDLED;
+    }
+
+    // Alarm request:
+    // bmRequestType = 0x41 to set the alarm (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the alarm (data direction: device to host)
+    // bmRequest: 0x49 (alarm request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data: alarm configuration (see `alarm_config`, little endian)
+    if (req->bRequest == ALARM_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            *len = std::min(*len, (uint16_t)sizeof(alarm_config));
+            memcpy(*buf, events_get_alarm(), *len);
+            return USBD_REQ_HANDLED;
+        }
+
+        alarm_config config;
+        if (*len != sizeof(config))
+            return USBD_REQ_NOTSUPP;
+
+        memcpy(&config, *buf, sizeof(config));
+        return events_set_alarm(&config) ? USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+    }
+
+    // Flush timeout request (packet fill policy):
+    // bmRequestType = 0x41 to set the timeout (data direction: host to device, type: vendor, recipient: interface)
+    //                 0xc1 to get the timeout (data direction: device to host, 2 bytes)
+    // bmRequest: 0x47 (flush timeout request)
+    // wValue: timeout in ms (0 to only transmit full packets)
+    // wIndex: 0 (interface number)
+    if (req->bRequest == FLUSH_TIMEOUT_ID && req->wIndex == INTF_COMM)
+    {
+        if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+        {
+            uint16_t timeout = encoder_get_flush_timeout();
+            *len = std::min(*len, (uint16_t)sizeof(timeout));
+            memcpy(*buf, &timeout, *len);
+            return USBD_REQ_HANDLED;
+        }
+
+        encoder_set_flush_timeout(req->wValue);
+        return USBD_REQ_HANDLED;
+    }
+
+    // Configuration request:
+    // bmRequestType = 0xc1 (data direction: device to host, type: vendor, recipient: interface)
+    // bmRequest: 0x48 (configuration request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data: active configuration (see `logger_config`, little endian)
+    if (req->bRequest == CONFIG_ID && req->wIndex == INTF_COMM
+        && (req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+    {
+        logger_config config;
+        config.sample_rate = sampler_get_rate();
+        config.channels = sampler_get_channels();
+        config.format = encoder_get_format();
+        config.mode = sampler_get_mode();
+        config.decimation = sampler_get_decimation();
+        config.flush_timeout = encoder_get_flush_timeout();
+        config.vdda = sampler_get_vdda();
+        config.trigger = *trigger_get_config();
+        config.alarm = *events_get_alarm();
+
+        *len = std::min(*len, (uint16_t)sizeof(config));
+        memcpy(*buf, &config, *len);
+        return USBD_REQ_HANDLED;
+    }
+
+    // Counters request:
+    // bmRequestType = 0xc1 (data direction: device to host, type: vendor, recipient: interface)
+    // bmRequest: 0x41 (counters request)
+    // wValue: 0
+    // wIndex: 0 (interface number)
+    // data: counters (see `logger_counters`, 32-bit unsigned integers, little endian)
+    if (req->bRequest == COUNTERS_ID && req->wIndex == INTF_COMM
+        && (req->bmRequestType & USB_REQ_TYPE_DIRECTION) == USB_REQ_TYPE_IN)
+    {
+        counters.num_triggers = trigger_get_count();
+        *len = std::min(*len, (uint16_t)sizeof(counters));
+        memcpy(*buf, &counters, *len);
+        return USBD_REQ_HANDLED;
+    }
+
+    // pass on to next request handler
+    return USBD_REQ_NEXT_CALLBACK;
 }
 
-// Sends a package of samples
-static void send_samples()
+// Called from the DMA interrupt handler when a block of samples is ready
+void samples_ready(const uint16_t *samples, int num_samples, uint32_t timestamp)
 {
+    counters.num_samples += num_samples;
+
     if (!is_configured)
         return;
-    usbd_ep_write_packet(usb_device, EP_DATA_IN, &samples, sizeof(samples));
+
+    encoder_set_vdda(sampler_get_vdda());
+    events_check_alarm(samples, num_samples, timestamp, sampler_get_frame_period());
+
+    if (trigger_is_enabled())
+    {
+        // only the captured windows are transmitted
+        trigger_add_samples(samples, num_samples, timestamp, sampler_get_frame_period());
+    }
+    else
+    {
+        // samples are dropped if the host does not collect the data fast enough
+        int num_dropped = encoder_add_samples(samples, num_samples, timestamp, sampler_get_frame_period());
+        if (num_dropped > 0)
+        {
+            counters.num_dropped_samples += num_dropped;
+            encoder_mark_gap();
+
+            // report the start of an overrun
+            if (!is_overrun)
+                events_add(EVENT_OVERRUN, 0, std::min(num_dropped, 0xffff), timestamp);
+        }
+        is_overrun = num_dropped > 0;
+
+        // transmit partially filled packet if it has been waiting for too long
+        encoder_check_timeout(micros());
+    }
+
+    usb_start_tx();
+    usb_start_event_tx();
 }
 
-// Takes a single sample
-static void adc_once()
+// Called from the DMA interrupt handler when a block of samples has been overwritten before it was processed
+void samples_dropped(int num_samples, uint32_t timestamp)
 {
-    adc_start_conversion_direct(ADC1);
-    while (!(adc_eoc(ADC1)))
-        ;
-    uint32_t value = adc_read_regular(ADC1);
+    counters.num_samples += num_samples;
+    counters.num_dropped_samples += num_samples;
 
-    samples[num_samples++] = (uint16_t)value;
-    if (num_samples == SAMPLES_PER_MESSAGE) {
-        send_samples();
-        num_samples = 0;
-    }
+    if (!is_configured)
+        return;
+
+    encoder_mark_gap();
+
+    // report the start of an overrun
+    if (!is_overrun)
+        events_add(EVENT_OVERRUN, 0, std::min(num_samples, 0xffff), timestamp);
+    is_overrun = true;
+
+    usb_start_event_tx();
+}
+
+// Starts transmitting the next packet (unless a transmission is in progress)
+void usb_start_tx()
+{
+    // isochronous packets are prepared after each frame's transmission
+    if (is_tx_busy || iso_packets_per_frame > 0)
+        return;
+
+    int len;
+    const uint8_t *packet = tx_queue_peek(&len);
+    if (packet == nullptr)
+        return;
+
+    usbd_ep_write_packet(usb_device, EP_DATA_IN, packet, len);
+    is_tx_busy = true;
 }
 
 // Called when data has been transmitted
 void usb_data_transmitted(__attribute__((unused)) usbd_device *usbd_dev, __attribute__((unused)) uint8_t ep)
 {
-    // nothing to do
+    if (iso_packets_per_frame > 0)
+    {
+        // isochronous packet has been transmitted; prepare the one for the next frame
+        usb_iso_fill();
+        return;
+    }
+
+    // packet has been collected by the host; continue with next one
+    tx_queue_remove();
+    is_tx_busy = false;
+    trigger_ship();
+    usb_start_tx();
+}
+
+// Prepares the isochronous packet for the next frame from the queued packets
+// (each prefixed with its length, possibly none). The packets are removed
+// from the queue right away: a packet lost on the bus is not retransmitted,
+// and the host detects the loss from the sequence numbers.
+//
+// The packet is prepared when the previous one has been transmitted rather
+// than on SOF as the host usually polls isochronous endpoints right after SOF.
+void usb_iso_fill()
+{
+    static uint8_t iso_packet[ISO_PACKET_SIZE(ISO_MAX_PACKETS_PER_FRAME)];
+
+    int size = 0;
+    for (int i = 0; i < iso_packets_per_frame; i++)
+    {
+        int len;
+        const uint8_t *packet = tx_queue_peek(&len);
+        if (packet == nullptr)
+            break;
+
+        iso_packet[size] = len;
+        memcpy(iso_packet + size + 1, packet, len);
+        size += 1 + len;
+        tx_queue_remove();
+    }
+
+    usb_iso_ep_write_packet(EP_DATA_IN, iso_packet, size);
+    trigger_ship();
+}
+
+// Starts transmitting the queued events (unless a transmission is in progress)
+void usb_start_event_tx()
+{
+    if (is_event_tx_busy)
+        return;
+
+    uint8_t packet[INTR_MAX_PACKET_SIZE];
+    int len = events_take(packet, sizeof(packet));
+    if (len == 0)
+        return;
+
+    usbd_ep_write_packet(usb_device, EP_EVENT_IN, packet, len);
+    is_event_tx_busy = true;
+}
+
+// Called when events have been transmitted
+void usb_event_transmitted(__attribute__((unused)) usbd_device *usbd_dev, __attribute__((unused)) uint8_t ep)
+{
+    is_event_tx_busy = false;
+    usb_start_event_tx();
 }
 
 int main()
 {
     init();
     usb_init();
-    adc_init();
+    sampler_init(samples_ready, samples_dropped);
+    sampler_start();
 
-    uint32_t next_time = millis() + 1;
     while (true)
-    {
-        if (next_time != millis())
-            continue;
-
-        adc_once();
-        next_time += 10; // next sampling in 10ms
-    }
+        ; // do nothing; all the action is in interrupt handlers
 }
 
 // USB interrupt handler
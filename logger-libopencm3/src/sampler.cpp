@@ -0,0 +1,613 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Sampler (timer-triggered ADC with DMA)
+ *
+ * TIM3 generates a trigger output (TRGO) on each update event.
+ * It starts a conversion of all selected channels by ADC1 (scan mode),
+ * which then requests a DMA transfer for each result. DMA1 channel 1 runs in circular mode and raises
+ * an interrupt when the first half and when the second half of
+ * the buffer has been filled. So the application can process
+ * one half while the DMA controller fills the other half.
+ * If the interrupt is handled so late that the DMA controller is
+ * already overwriting the half to be processed, the block is dropped.
+ *
+ * In fast interleaved mode, TIM3 is not used. ADC1 and ADC2 continuously
+ * convert the same channel, with ADC2 starting 7 ADC clock cycles before ADC1
+ * (dual fast interleaved mode). Each result of ADC1 together with the preceding
+ * result of ADC2 is transferred by DMA as a 32-bit word from ADC1's data register.
+ *
+ * If decimation is enabled, the ADC runs at a multiple of the sample rate
+ * and the blocks are decimated before they are passed to the callback.
+ *
+ * The supply voltage VDDA (the ADC's reference voltage) is periodically
+ * derived from the internal reference voltage VREFINT. It is measured by
+ * an injected conversion triggered by TIM3 CC4 in the middle of the
+ * sample period, i.e. between two scans of the regular channels.
+ */
+
+#include "sampler.h"
+#include "common.h"
+#include "decimator.h"
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+
+static void timer_init();
+static void dma_init();
+static void adc_init();
+static void configure();
+static void update_timing();
+static void process_block(uint16_t *samples);
+static void handle_half(int half);
+static void update_vdda(uint32_t vref_value);
+
+// DMA buffer: two halves of up to `SAMPLER_FAST_BLOCK_SIZE` samples
+// (word aligned for 32-bit transfers in fast interleaved mode)
+alignas(4) static uint16_t dma_buf[2 * SAMPLER_FAST_BLOCK_SIZE];
+
+// number of samples per half of DMA buffer (whole frames)
+static int block_len = SAMPLER_BLOCK_SIZE;
+// number of DMA transfers per half of DMA buffer
+static int block_transfers = SAMPLER_BLOCK_SIZE;
+
+// target duration of a block (in ms), limiting the latency at low sample rates
+static constexpr uint32_t BLOCK_DURATION_MS = 10;
+
+// decimation filter and buffer for decimated samples
+static decimator decim;
+static int log2_decimation = 0;
+static uint16_t decimated_buf[SAMPLER_FAST_BLOCK_SIZE];
+
+static sampler_callback block_callback;
+static sampler_drop_callback block_drop_callback;
+
+static sampler_mode mode = SAMPLER_MODE_NORMAL;
+static uint8_t channel_mask = 1;
+static int num_channels = 1;
+static bool is_running = false;
+
+// ADC clock prescaler in fast interleaved mode (6 or 8)
+static uint32_t fast_adc_prescaler = 6;
+
+// time between two frames of the ADC (in ns)
+static uint32_t adc_period_ns;
+// time between two frames after decimation (in ns)
+static uint32_t frame_period_ns;
+// time between the first and the last frame of a block (in µs)
+static uint32_t block_duration_us;
+
+// typical value of internal reference voltage VREFINT (in mV)
+static constexpr uint32_t VREFINT_MV = 1200;
+// interval between VREFINT measurements (in µs)
+static constexpr uint32_t VREF_INTERVAL_US = 100000;
+
+// VREFINT measurement
+static uint32_t vref_average; // moving average of VREFINT value (x16)
+static uint16_t vdda_mv = 3300;
+static bool can_measure_vref;
+static bool is_vref_pending;
+static uint32_t last_vref_time;
+
+// sample period (in timer ticks) = prescaler x period
+static uint32_t timer_prescaler;
+static uint32_t timer_period;
+
+static uint32_t timer_freq()
+{
+    // TIM3 is on APB1; its clock is doubled as APB1 runs at half the AHB frequency
+    return rcc_apb1_frequency * 2;
+}
+
+// Returns the rate of the frames triggered by the timer (normal mode)
+static uint32_t timer_rate()
+{
+    uint32_t ticks = timer_prescaler * timer_period;
+    return (timer_freq() + ticks / 2) / ticks;
+}
+
+// Returns the sample rate in fast interleaved mode for the given ADC prescaler
+static uint32_t fast_rate(uint32_t adc_prescaler)
+{
+    // each ADC needs 14 ADC clock cycles per conversion (1.5 cycles sample time);
+    // interleaved, there is a new result every 7 cycles
+    return rcc_apb2_frequency / adc_prescaler / 7;
+}
+
+// Returns the number of frames per block for the current rate (normal mode)
+static int frames_per_block()
+{
+    int max_frames = SAMPLER_BLOCK_SIZE / num_channels;
+    if (timer_period == 0)
+        return max_frames;
+
+    int frames = timer_rate() * BLOCK_DURATION_MS / 1000;
+    if (frames < 1)
+        return 1;
+    return frames < max_frames ? frames : max_frames;
+}
+
+void sampler_init(sampler_callback callback, sampler_drop_callback drop_callback)
+{
+    block_callback = callback;
+    block_drop_callback = drop_callback;
+    timer_init();
+    dma_init();
+    adc_init();
+    sampler_set_rate(SAMPLER_DEFAULT_RATE);
+}
+
+bool sampler_set_rate(uint32_t rate)
+{
+    if (rate < SAMPLER_MIN_RATE || rate > (UINT32_MAX >> DECIMATOR_MAX_LOG2_RATIO))
+        return false;
+
+    // the ADC runs at a multiple of the rate if decimation is enabled
+    uint32_t adc_rate = rate << log2_decimation;
+
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+    {
+        // only two rates are available: select the nearer one
+        // (ADC clock of 12 MHz or 9 MHz; the maximum ADC clock is 14 MHz)
+        uint32_t prescaler = adc_rate >= (fast_rate(6) + fast_rate(8)) / 2 ? 6 : 8;
+        if (prescaler != fast_adc_prescaler)
+        {
+            bool was_running = is_running;
+            sampler_stop();
+            fast_adc_prescaler = prescaler;
+            configure();
+            if (was_running)
+                sampler_start();
+        }
+        return true;
+    }
+
+    if (adc_rate > SAMPLER_MAX_RATE / (uint32_t)num_channels)
+        return false;
+
+    // the timer's prescaler and period are 16-bit values
+    uint32_t ticks = timer_freq() / adc_rate;
+    uint32_t prescaler = (ticks - 1) / 65536 + 1;
+    timer_prescaler = prescaler;
+    timer_period = ticks / prescaler;
+
+    // restart period (so the counter does not overshoot a reduced period)
+    timer_set_prescaler(TIM3, timer_prescaler - 1);
+    timer_set_period(TIM3, timer_period - 1);
+    timer_set_oc_value(TIM3, TIM_OC4, timer_period / 2);
+    timer_set_counter(TIM3, 0);
+    update_timing();
+
+    // adapt the block length to the rate
+    if (frames_per_block() * num_channels != block_len)
+    {
+        bool was_running = is_running;
+        sampler_stop();
+        configure();
+        if (was_running)
+            sampler_start();
+    }
+    return true;
+}
+
+uint32_t sampler_get_rate()
+{
+    uint32_t adc_rate = mode == SAMPLER_MODE_FAST_INTERLEAVED ? fast_rate(fast_adc_prescaler) : timer_rate();
+    return (adc_rate + ((1 << log2_decimation) >> 1)) >> log2_decimation;
+}
+
+bool sampler_set_channels(uint8_t mask)
+{
+    int n = 0;
+    for (int ch = 0; ch < SAMPLER_MAX_CHANNELS; ch++)
+    {
+        if ((mask & (1 << ch)) != 0)
+            n++;
+    }
+
+    if (n == 0)
+        return false;
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED ? n != 1 : timer_rate() * n > SAMPLER_MAX_RATE)
+        return false;
+
+    bool was_running = is_running;
+    sampler_stop();
+
+    channel_mask = mask;
+    num_channels = n;
+    configure();
+
+    if (was_running)
+        sampler_start();
+    return true;
+}
+
+uint32_t sampler_get_frame_period()
+{
+    return frame_period_ns;
+}
+
+uint16_t sampler_get_vdda()
+{
+    return vdda_mv;
+}
+
+uint8_t sampler_get_channels()
+{
+    return channel_mask;
+}
+
+bool sampler_set_decimation(uint32_t ratio)
+{
+    int log2_ratio = 0;
+    while ((1U << log2_ratio) < ratio && log2_ratio < DECIMATOR_MAX_LOG2_RATIO)
+        log2_ratio++;
+    if (ratio != (1U << log2_ratio))
+        return false;
+
+    bool was_running = is_running;
+    sampler_stop();
+
+    // keep the output sample rate
+    uint32_t rate = sampler_get_rate();
+    int prev_log2_ratio = log2_decimation;
+    log2_decimation = log2_ratio;
+    bool is_valid = sampler_set_rate(rate);
+    if (!is_valid)
+        log2_decimation = prev_log2_ratio;
+
+    decimator_init(&decim, num_channels, log2_decimation);
+    update_timing();
+
+    if (was_running)
+        sampler_start();
+    return is_valid;
+}
+
+uint32_t sampler_get_decimation()
+{
+    return 1 << log2_decimation;
+}
+
+bool sampler_set_mode(uint8_t new_mode)
+{
+    if (new_mode != SAMPLER_MODE_NORMAL && new_mode != SAMPLER_MODE_FAST_INTERLEAVED)
+        return false;
+
+    // fast interleaved mode only supports a single channel
+    if (new_mode == SAMPLER_MODE_FAST_INTERLEAVED && num_channels != 1)
+        return false;
+
+    bool was_running = is_running;
+    sampler_stop();
+
+    mode = static_cast<sampler_mode>(new_mode);
+    configure();
+
+    if (was_running)
+        sampler_start();
+    return true;
+}
+
+sampler_mode sampler_get_mode()
+{
+    return mode;
+}
+
+void sampler_start()
+{
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+    {
+        adc_set_continuous_conversion_mode(ADC1);
+        adc_set_continuous_conversion_mode(ADC2);
+        adc_start_conversion_regular(ADC1);
+    }
+    else
+    {
+        timer_set_counter(TIM3, 0);
+        timer_enable_counter(TIM3);
+    }
+    is_running = true;
+}
+
+void sampler_stop()
+{
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+    {
+        // stop after the current conversion
+        adc_set_single_conversion_mode(ADC1);
+        adc_set_single_conversion_mode(ADC2);
+    }
+    else
+    {
+        timer_disable_counter(TIM3);
+    }
+    is_running = false;
+}
+
+// Configures the ADCs and the DMA buffer for the selected mode and channels (sampling must be stopped)
+void configure()
+{
+    // wait for the current scan to complete
+    delay(2);
+
+    // configure the pins of the selected channels (PA0 to PA7) as analog inputs
+    gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG, channel_mask);
+
+    uint8_t channels[SAMPLER_MAX_CHANNELS];
+    int n = 0;
+    for (int ch = 0; ch < SAMPLER_MAX_CHANNELS; ch++)
+    {
+        if ((channel_mask & (1 << ch)) != 0)
+            channels[n++] = ADC_CHANNEL0 + ch;
+    }
+
+    dma_disable_channel(DMA1, DMA_CHANNEL1);
+    dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_HTIF | DMA_TCIF);
+
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+    {
+        // both ADCs convert the same channel, started by software (continuous mode)
+        rcc_set_adcpre(fast_adc_prescaler == 6 ? RCC_CFGR_ADCPRE_DIV6 : RCC_CFGR_ADCPRE_DIV8);
+        adc_set_dual_mode(ADC_CR1_DUALMOD_FIM);
+        adc_disable_scan_mode(ADC1);
+        adc_set_regular_sequence(ADC1, 1, channels);
+        adc_set_regular_sequence(ADC2, 1, channels);
+        adc_set_sample_time_on_all_channels(ADC1, ADC_SMPR_SMP_1DOT5CYC);
+        adc_set_sample_time_on_all_channels(ADC2, ADC_SMPR_SMP_1DOT5CYC);
+        adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_SWSTART);
+        adc_enable_external_trigger_regular(ADC2, ADC_CR2_EXTSEL_SWSTART);
+
+        // transfer ADC1 and ADC2 result together as a 32-bit word
+        block_len = SAMPLER_FAST_BLOCK_SIZE;
+        block_transfers = block_len / 2;
+        dma_set_peripheral_size(DMA1, DMA_CHANNEL1, DMA_CCR_PSIZE_32BIT);
+        dma_set_memory_size(DMA1, DMA_CHANNEL1, DMA_CCR_MSIZE_32BIT);
+        dma_set_number_of_data(DMA1, DMA_CHANNEL1, 2 * block_transfers);
+    }
+    else
+    {
+        // ADC1 converts all selected channels (scan mode), triggered by TIM3
+        rcc_set_adcpre(RCC_CFGR_ADCPRE_DIV8);
+        adc_set_dual_mode(ADC_CR1_DUALMOD_IND);
+        adc_enable_scan_mode(ADC1);
+        adc_set_regular_sequence(ADC1, n, channels);
+        adc_set_sample_time_on_all_channels(ADC1, ADC_SMPR_SMP_28DOT5CYC);
+        adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM3_TRGO);
+
+        // each half of the buffer starts with the first channel
+        block_len = frames_per_block() * n;
+        block_transfers = block_len;
+        dma_set_peripheral_size(DMA1, DMA_CHANNEL1, DMA_CCR_PSIZE_16BIT);
+        dma_set_memory_size(DMA1, DMA_CHANNEL1, DMA_CCR_MSIZE_16BIT);
+        dma_set_number_of_data(DMA1, DMA_CHANNEL1, 2 * block_transfers);
+    }
+
+    dma_set_memory_address(DMA1, DMA_CHANNEL1, (uint32_t)dma_buf);
+    dma_enable_channel(DMA1, DMA_CHANNEL1);
+
+    // cancel pending VREFINT measurement; VREFINT requires a sample time of at least 17.1 µs
+    adc_disable_external_trigger_injected(ADC1);
+    is_vref_pending = false;
+    adc_set_sample_time(ADC1, ADC_CHANNEL17, ADC_SMPR_SMP_239DOT5CYC);
+
+    decimator_init(&decim, num_channels, log2_decimation);
+    update_timing();
+}
+
+// Swaps the ADC1 and ADC2 results of each 32-bit word so the samples are in chronological order
+static void swap_interleaved(uint16_t *samples, int num_samples)
+{
+    uint32_t *words = reinterpret_cast<uint32_t *>(samples);
+    for (int i = 0; i < num_samples / 2; i++)
+        words[i] = (words[i] >> 16) | (words[i] << 16);
+}
+
+// Updates the frame period and block duration (used for the timestamps)
+void update_timing()
+{
+    uint64_t period_ns;
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+        period_ns = 7 * fast_adc_prescaler * 1000000000ULL / rcc_apb2_frequency;
+    else
+        period_ns = (uint64_t)timer_prescaler * timer_period * 1000000000ULL / timer_freq();
+
+    adc_period_ns = period_ns;
+    frame_period_ns = period_ns << log2_decimation;
+    block_duration_us = (block_len / num_channels - 1) * period_ns / 1000;
+
+    // VREFINT can be measured if the ADC is idle for half of the period
+    // (scan: 41 ADC clock cycles per channel, VREFINT: 252 cycles)
+    uint64_t period_cycles = period_ns * (rcc_apb2_frequency / 8) / 1000000000;
+    uint32_t busy_cycles = num_channels * 41 > 252 ? num_channels * 41 : 252;
+    can_measure_vref = mode == SAMPLER_MODE_NORMAL && period_cycles / 2 >= busy_cycles;
+}
+
+// Updates VDDA from the VREFINT value
+void update_vdda(uint32_t vref_value)
+{
+    if (vref_average == 0)
+        vref_average = vref_value << 4;
+    else
+        vref_average += vref_value - (vref_average >> 4);
+
+    // VREFINT = VDDA x value / 4095
+    vdda_mv = VREFINT_MV * 4095 * 16 / vref_average;
+}
+
+// Starts a VREFINT measurement or processes its result
+static void measure_vref()
+{
+    if (is_vref_pending)
+    {
+        if (!adc_eoc_injected(ADC1))
+            return;
+
+        // clear JEOC (writing 1 to the other flags has no effect)
+        ADC_SR(ADC1) = ~ADC_SR_JEOC;
+        adc_disable_external_trigger_injected(ADC1);
+        is_vref_pending = false;
+        last_vref_time = micros();
+        update_vdda(adc_read_injected(ADC1, 1));
+    }
+    else if (can_measure_vref && is_running && micros() - last_vref_time >= VREF_INTERVAL_US)
+    {
+        // convert once on next TIM3 CC4 event
+        ADC_SR(ADC1) = ~ADC_SR_JEOC;
+        adc_enable_external_trigger_injected(ADC1, ADC_CR2_JEXTSEL_TIM3_CC4);
+        is_vref_pending = true;
+    }
+}
+
+// Passes a block of samples to the callback (after decimation if enabled)
+void process_block(uint16_t *samples)
+{
+    // time of first frame of block (the last frame has just been converted)
+    uint32_t timestamp = micros() - block_duration_us;
+
+    measure_vref();
+
+    if (mode == SAMPLER_MODE_FAST_INTERLEAVED)
+        swap_interleaved(samples, block_len);
+
+    if (log2_decimation == 0)
+    {
+        block_callback(samples, block_len, timestamp);
+        return;
+    }
+
+    // index of the input frame completing the first output frame
+    int ratio = 1 << log2_decimation;
+    int first_end = ratio - 1 - decim.count;
+
+    int num_frames = decimator_process(&decim, samples, block_len / num_channels, decimated_buf);
+    if (num_frames == 0)
+        return;
+
+    // timestamp of output frame is the center of the averaged input frames
+    int32_t offset_ns = (int64_t)(2 * first_end - (ratio - 1)) * adc_period_ns / 2;
+    block_callback(decimated_buf, num_frames * num_channels, timestamp + offset_ns / 1000);
+}
+
+// Drops the block (as the DMA controller is already overwriting it)
+static void drop_block()
+{
+    // the partially summed up output frame is lost as well
+    int num_frames = (decim.count + block_len / num_channels) >> log2_decimation;
+    decimator_init(&decim, num_channels, log2_decimation);
+
+    uint32_t timestamp = micros() - block_duration_us;
+    block_drop_callback(num_frames * num_channels, timestamp);
+}
+
+// Processes the given half of the DMA buffer unless the DMA controller is already writing to it
+void handle_half(int half)
+{
+    // index of the next DMA transfer
+    int index = 2 * block_transfers - DMA_CNDTR(DMA1, DMA_CHANNEL1);
+    if (index / block_transfers == half)
+        drop_block();
+    else
+        process_block(dma_buf + half * block_len);
+}
+
+void timer_init()
+{
+    rcc_periph_clock_enable(RCC_TIM3);
+    rcc_periph_reset_pulse(RST_TIM3);
+
+    timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+
+    // generate trigger output on update event
+    timer_set_master_mode(TIM3, TIM_CR2_MMS_UPDATE);
+
+    // CC4 event in the middle of the period (for VREFINT measurement)
+    timer_set_oc_mode(TIM3, TIM_OC4, TIM_OCM_PWM1);
+    timer_enable_oc_output(TIM3, TIM_OC4);
+}
+
+void dma_init()
+{
+    rcc_periph_clock_enable(RCC_DMA1);
+    dma_channel_reset(DMA1, DMA_CHANNEL1);
+    dma_set_peripheral_address(DMA1, DMA_CHANNEL1, (uint32_t)&ADC_DR(ADC1));
+    dma_set_read_from_peripheral(DMA1, DMA_CHANNEL1);
+    dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL1);
+    dma_enable_circular_mode(DMA1, DMA_CHANNEL1);
+    dma_set_priority(DMA1, DMA_CHANNEL1, DMA_CCR_PL_HIGH);
+    dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL1);
+    dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL1);
+
+    // Same priority as USB interrupt so the handlers do not interrupt each other
+    nvic_set_priority(NVIC_DMA1_CHANNEL1_IRQ, 2 << 6);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL1_IRQ);
+}
+
+void adc_init()
+{
+    // ADC2 is only used in fast interleaved mode
+    rcc_periph_clock_enable(RCC_ADC1);
+    rcc_periph_clock_enable(RCC_ADC2);
+    adc_power_off(ADC1);
+    adc_power_off(ADC2);
+
+    // configure for regular single conversion (the sequence is set by configure())
+    adc_set_single_conversion_mode(ADC1);
+    adc_set_single_conversion_mode(ADC2);
+    adc_set_right_aligned(ADC1);
+    adc_set_right_aligned(ADC2);
+
+    // power up
+    adc_power_on(ADC1);
+    adc_power_on(ADC2);
+    delay(100);
+    adc_reset_calibration(ADC1);
+    adc_calibrate(ADC1);
+    adc_reset_calibration(ADC2);
+    adc_calibrate(ADC2);
+
+    // start conversion on trigger (depending on mode) and transfer result by DMA
+    configure();
+    adc_enable_dma(ADC1);
+
+    // enable VREFINT and measure it once (triggered by software)
+    uint8_t vref_channel[] = {ADC_CHANNEL17};
+    adc_set_injected_sequence(ADC1, 1, vref_channel);
+    adc_enable_temperature_sensor();
+    delay(1);
+    adc_enable_external_trigger_injected(ADC1, ADC_CR2_JEXTSEL_JSWSTART);
+    adc_start_conversion_injected(ADC1);
+    while (!adc_eoc_injected(ADC1))
+        ;
+    ADC_SR(ADC1) = ~ADC_SR_JEOC;
+    adc_disable_external_trigger_injected(ADC1);
+    update_vdda(adc_read_injected(ADC1, 1));
+}
+
+// DMA interrupt handler
+extern "C" void dma1_channel1_isr()
+{
+    // If both flags are pending, the interrupt has been delayed by more than
+    // a block and the DMA controller is writing to one of the halves again.
+    // `handle_half()` detects this and drops the half.
+    if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_HTIF))
+    {
+        // first half is ready
+        dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_HTIF);
+        handle_half(0);
+    }
+
+    if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_TCIF))
+    {
+        // second half is ready
+        dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_TCIF);
+        handle_half(1);
+    }
+}
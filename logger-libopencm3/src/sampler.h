@@ -0,0 +1,202 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Sampler (timer-triggered ADC with DMA)
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+
+// Maximum number of samples per block (half of the DMA buffer)
+#define SAMPLER_BLOCK_SIZE 32
+
+// Number of samples per block in fast interleaved mode
+// (at 1.7 Msps, 32 samples would only leave 18.7 µs to process a block,
+// less than a USB interrupt at the same priority might take)
+#define SAMPLER_FAST_BLOCK_SIZE 256
+
+// Number of channels (channel n is on pin PAn)
+#define SAMPLER_MAX_CHANNELS 8
+
+// Minimum sample rate (in samples per second)
+#define SAMPLER_MIN_RATE 1
+// Maximum sample rate (in samples per second, for all channels together)
+#define SAMPLER_MAX_RATE 200000
+// Sample rate after initialization (in samples per second)
+#define SAMPLER_DEFAULT_RATE 100
+
+// Sampling mode
+enum sampler_mode : uint8_t
+{
+    // ADC1 triggered by TIM3 (configurable sample rate, up to 8 channels)
+    SAMPLER_MODE_NORMAL = 0,
+    // ADC1 and ADC2 in dual fast interleaved mode (single channel,
+    // 1.71 or 1.29 million samples per second)
+    SAMPLER_MODE_FAST_INTERLEAVED = 1,
+};
+
+/**
+ * @brief Function called when a block of samples is ready.
+ *
+ * The function is called from the DMA interrupt handler.
+ * The samples are only valid until the function returns.
+ *
+ * The block consists of whole frames, each containing a sample
+ * of each selected channel (in ascending channel order).
+ * At low sample rates, the blocks are shorter so they are passed on
+ * about every 10 ms.
+ *
+ * The timestamp is derived from the time of the DMA interrupt
+ * (when the last frame of the block has been converted).
+ *
+ * @param samples array of samples (12-bit values, right-aligned;
+ *   16-bit values if decimation is enabled)
+ * @param num_samples number of samples (all channels)
+ * @param timestamp time of the first frame (in µs, see `micros()`)
+ */
+typedef void (*sampler_callback)(const uint16_t *samples, int num_samples, uint32_t timestamp);
+
+/**
+ * @brief Function called when a block of samples has been dropped.
+ *
+ * A block is dropped if the DMA interrupt is handled too late and
+ * the DMA controller is already overwriting the block. The function
+ * is called from the DMA interrupt handler.
+ *
+ * @param num_samples number of dropped samples (all channels, after decimation)
+ * @param timestamp time of the first dropped frame (in µs, see `micros()`)
+ */
+typedef void (*sampler_drop_callback)(int num_samples, uint32_t timestamp);
+
+/**
+ * @brief Initializes the sampler.
+ *
+ * ADC1 is triggered by TIM3 and the samples are transferred by DMA
+ * into a circular buffer. Each time half of the buffer has been
+ * filled, the callback function is called.
+ *
+ * @param callback function called for each block of samples
+ * @param drop_callback function called for each dropped block
+ */
+void sampler_init(sampler_callback callback, sampler_drop_callback drop_callback);
+
+/**
+ * @brief Sets the sample rate.
+ *
+ * The sample rate is the number of frames per second, i.e. each channel
+ * is sampled at this rate. The effective sample rate might slightly
+ * deviate as it is derived from the 72 MHz timer clock.
+ *
+ * If decimation is enabled, this is the rate after decimation.
+ * The ADC runs at the rate multiplied by the decimation ratio.
+ *
+ * In fast interleaved mode, the nearer of the two available
+ * rates is selected.
+ *
+ * @param rate sample rate (in samples per second)
+ * @return `true` if successful, `false` if the sample rate is out of range
+ */
+bool sampler_set_rate(uint32_t rate);
+
+/**
+ * @brief Gets the effective sample rate.
+ *
+ * @return sample rate (in samples per second)
+ */
+uint32_t sampler_get_rate();
+
+/**
+ * @brief Gets the time between two frames.
+ *
+ * @return frame period (in ns)
+ */
+uint32_t sampler_get_frame_period();
+
+/**
+ * @brief Gets the supply voltage VDDA.
+ *
+ * VDDA is the reference voltage of the ADC, i.e. a sample value of
+ * 4095 (12-bit samples) corresponds to VDDA. It is periodically
+ * derived from the internal reference voltage (VREFINT) if the sample
+ * period is long enough to fit the measurement between two scans
+ * (normal mode).
+ *
+ * @return supply voltage (in mV)
+ */
+uint16_t sampler_get_vdda();
+
+/**
+ * @brief Sets the channels to sample.
+ *
+ * The channels are sampled in scan mode, i.e. one after the other
+ * in quick succession, each time the timer triggers the ADC.
+ *
+ * @param mask channel mask (bit n set to sample channel n)
+ * @return `true` if successful, `false` if the mask is empty, the
+ *   total sample rate would be exceeded or more than one channel is
+ *   selected in fast interleaved mode
+ */
+bool sampler_set_channels(uint8_t mask);
+
+/**
+ * @brief Gets the sampled channels.
+ *
+ * @return channel mask (bit n set if channel n is sampled)
+ */
+uint8_t sampler_get_channels();
+
+/**
+ * @brief Sets the decimation ratio.
+ *
+ * The ADC samples at a multiple of the sample rate and
+ * the average of each group of frames is output
+ * (boxcar filter). It increases the resolution of the output
+ * values, which are then scaled to 16 bits. The sample rate
+ * (after decimation) is kept.
+ *
+ * @param ratio decimation ratio (1, 2, 4, ... 256; 1 to disable decimation)
+ * @return `true` if successful, `false` if the ratio is invalid or
+ *   the ADC sample rate would be exceeded
+ */
+bool sampler_set_decimation(uint32_t ratio);
+
+/**
+ * @brief Gets the decimation ratio.
+ *
+ * @return decimation ratio (1 if decimation is disabled)
+ */
+uint32_t sampler_get_decimation();
+
+/**
+ * @brief Sets the sampling mode.
+ *
+ * Fast interleaved mode requires a single channel. It exceeds the
+ * bandwidth of the USB connection; samples are dropped if they cannot
+ * be transmitted.
+ *
+ * @param mode sampling mode (see `sampler_mode`)
+ * @return `true` if successful, `false` if the mode is invalid or
+ *   not possible with the selected channels
+ */
+bool sampler_set_mode(uint8_t mode);
+
+/**
+ * @brief Gets the sampling mode.
+ *
+ * @return sampling mode
+ */
+sampler_mode sampler_get_mode();
+
+/// Starts sampling
+void sampler_start();
+
+/// Stops sampling
+void sampler_stop();
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Trigger engine (triggered capture with pre-trigger history)
+ *
+ * While armed, the incoming frames are continuously recorded in a
+ * circular buffer so the frames before the trigger are available
+ * once the trigger fires. After the post-trigger frames have been
+ * recorded, the window is frozen and handed to the encoder as space
+ * in the transmit queue becomes available. Then the trigger is re-armed.
+ *
+ * All functions are called from the DMA and the USB interrupt handlers,
+ * which have the same priority and thus do not interrupt each other.
+ */
+
+#include "trigger.h"
+#include "common.h"
+#include "encoder.h"
+#include "events.h"
+
+enum trigger_state
+{
+    STATE_ARMED,     // recording history, waiting for trigger
+    STATE_CAPTURING, // recording post-trigger frames
+    STATE_SHIPPING,  // transmitting captured window
+};
+
+static uint16_t buffer[TRIGGER_BUFFER_SIZE];
+
+static trigger_config config = {TRIGGER_OFF, 0, 2048, 100, 400};
+static trigger_state state = STATE_ARMED;
+static uint32_t trigger_count;
+
+static uint8_t channel_mask = 1;
+static int num_channels = 1;
+static int trigger_index = 0; // index of trigger channel within frame
+static int buffer_frames = TRIGGER_BUFFER_SIZE; // capacity of buffer (in frames)
+
+static int head;           // index of next frame to record
+static int num_history;    // number of frames recorded since the trigger was armed
+static int num_remaining;  // frames still to record (capturing) or to transmit (shipping)
+static int ship_index;     // index of next frame to transmit
+static uint16_t prev_value; // previous value of trigger channel
+
+static uint32_t frame_period_ns;
+static uint32_t window_timestamp; // time of first frame of window (in µs)
+static int num_shipped;           // number of frames of window already transmitted
+
+// Checks if the trigger condition is met for the given value
+static bool is_triggered(uint16_t value)
+{
+    switch (config.mode)
+    {
+    case TRIGGER_RISING_EDGE:
+        return num_history > 0 && prev_value < config.level && value >= config.level;
+    case TRIGGER_FALLING_EDGE:
+        return num_history > 0 && prev_value >= config.level && value < config.level;
+    case TRIGGER_ABOVE_LEVEL:
+        return value >= config.level;
+    case TRIGGER_BELOW_LEVEL:
+        return value < config.level;
+    default:
+        return false;
+    }
+}
+
+// Checks if the configuration is valid for the given channels
+static bool is_valid(const trigger_config *cfg, uint8_t mask)
+{
+    if (cfg->mode > TRIGGER_BELOW_LEVEL)
+        return false;
+    if (cfg->mode == TRIGGER_OFF)
+        return true;
+
+    int n = count_channels(mask);
+    return channel_index(mask, cfg->channel) >= 0 && cfg->post_trigger >= 1
+        && ((int)cfg->pre_trigger + cfg->post_trigger) * n <= TRIGGER_BUFFER_SIZE;
+}
+
+bool trigger_set_config(const trigger_config *cfg)
+{
+    if (!is_valid(cfg, channel_mask))
+        return false;
+
+    config = *cfg;
+    trigger_set_channels(channel_mask);
+    return true;
+}
+
+const trigger_config *trigger_get_config()
+{
+    return &config;
+}
+
+void trigger_set_channels(uint8_t mask)
+{
+    channel_mask = mask;
+    num_channels = count_channels(mask);
+    trigger_index = channel_index(mask, config.channel);
+    buffer_frames = TRIGGER_BUFFER_SIZE / num_channels;
+
+    // the trigger is disabled if the configuration is no longer valid
+    if (!is_valid(&config, mask))
+    {
+        config.mode = TRIGGER_OFF;
+        trigger_index = 0;
+    }
+
+    trigger_reset();
+}
+
+bool trigger_is_enabled()
+{
+    return config.mode != TRIGGER_OFF;
+}
+
+void trigger_add_samples(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period)
+{
+    if (state == STATE_SHIPPING)
+        return;
+
+    // restart recording if the sample rate has changed
+    if (frame_period != frame_period_ns)
+    {
+        trigger_reset();
+        frame_period_ns = frame_period;
+    }
+
+    int num_frames = num_samples / num_channels;
+    for (int i = 0; i < num_frames; i++)
+    {
+        const uint16_t *frame = samples + i * num_channels;
+
+        if (state == STATE_ARMED)
+        {
+            uint16_t value = frame[trigger_index];
+            if (num_history >= config.pre_trigger && is_triggered(value))
+            {
+                state = STATE_CAPTURING;
+                num_remaining = config.post_trigger;
+                ship_index = head - config.pre_trigger;
+                if (ship_index < 0)
+                    ship_index += buffer_frames;
+                int64_t offset_ns = ((int64_t)i - config.pre_trigger) * frame_period_ns;
+                window_timestamp = timestamp + (int32_t)(offset_ns / 1000);
+                trigger_count++;
+                events_add(EVENT_TRIGGER, config.channel, value,
+                           timestamp + (uint32_t)((uint64_t)i * frame_period_ns / 1000));
+            }
+            prev_value = value;
+        }
+
+        // record frame
+        uint16_t *dest = buffer + head * num_channels;
+        for (int ch = 0; ch < num_channels; ch++)
+            dest[ch] = frame[ch];
+        head++;
+        if (head >= buffer_frames)
+            head = 0;
+        if (num_history < buffer_frames)
+            num_history++;
+
+        if (state == STATE_CAPTURING)
+        {
+            num_remaining--;
+            if (num_remaining == 0)
+            {
+                // window is complete; remaining frames are ignored
+                state = STATE_SHIPPING;
+                num_remaining = config.pre_trigger + config.post_trigger;
+                num_shipped = 0;
+                encoder_mark_window_start();
+                trigger_ship();
+                return;
+            }
+        }
+    }
+}
+
+void trigger_ship()
+{
+    if (state != STATE_SHIPPING)
+        return;
+
+    while (num_remaining > 0)
+    {
+        // contiguous part of window (up to the end of the buffer)
+        int len = num_remaining;
+        if (ship_index + len > buffer_frames)
+            len = buffer_frames - ship_index;
+
+        uint32_t timestamp = window_timestamp + (uint32_t)((uint64_t)num_shipped * frame_period_ns / 1000);
+        int num_pending = encoder_add_samples(buffer + ship_index * num_channels, len * num_channels,
+                                              timestamp, frame_period_ns);
+        int num_added = len - num_pending / num_channels;
+
+        ship_index += num_added;
+        if (ship_index >= buffer_frames)
+            ship_index = 0;
+        num_shipped += num_added;
+        num_remaining -= num_added;
+
+        if (num_pending > 0)
+            return; // transmit queue is full; continue later
+    }
+
+    // window has been transmitted; re-arm
+    encoder_flush();
+    trigger_reset();
+}
+
+void trigger_reset()
+{
+    state = STATE_ARMED;
+    head = 0;
+    num_history = 0;
+}
+
+uint32_t trigger_get_count()
+{
+    return trigger_count;
+}
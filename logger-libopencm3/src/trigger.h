@@ -0,0 +1,111 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Trigger engine (triggered capture with pre-trigger history)
+ */
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <stdint.h>
+
+// Size of the capture buffer (in samples, all channels)
+#define TRIGGER_BUFFER_SIZE 4096
+
+// Trigger mode
+enum trigger_mode : uint8_t
+{
+    // no trigger: all samples are transmitted
+    TRIGGER_OFF = 0,
+    // trigger when the value rises to or above the level
+    TRIGGER_RISING_EDGE = 1,
+    // trigger when the value falls below the level
+    TRIGGER_FALLING_EDGE = 2,
+    // trigger when the value is at or above the level
+    TRIGGER_ABOVE_LEVEL = 3,
+    // trigger when the value is below the level
+    TRIGGER_BELOW_LEVEL = 4,
+};
+
+// Trigger configuration
+struct trigger_config
+{
+    uint8_t mode;          // trigger mode (see `trigger_mode`)
+    uint8_t channel;       // channel the trigger applies to (0 to 7)
+    uint16_t level;        // trigger level (in sample units)
+    uint16_t pre_trigger;  // number of frames before the trigger frame
+    uint16_t post_trigger; // number of frames starting with the trigger frame (at least 1)
+} __attribute__((packed));
+
+/**
+ * @brief Sets the trigger configuration and re-arms the trigger.
+ *
+ * The trigger channel must be one of the sampled channels,
+ * and the captured window must fit into the capture buffer.
+ *
+ * @param config trigger configuration
+ * @return `true` if successful, `false` if the configuration is invalid
+ */
+bool trigger_set_config(const trigger_config *config);
+
+/**
+ * @brief Gets the trigger configuration.
+ *
+ * @return trigger configuration
+ */
+const trigger_config *trigger_get_config();
+
+/**
+ * @brief Sets the sampled channels and re-arms the trigger.
+ *
+ * If the configuration is no longer valid for these channels,
+ * the trigger is disabled.
+ *
+ * @param mask channel mask (bit n set if channel n is sampled)
+ */
+void trigger_set_channels(uint8_t mask);
+
+/**
+ * @brief Indicates if the trigger is enabled.
+ *
+ * @return `true` if samples pass through the trigger engine, `false` if all samples are transmitted
+ */
+bool trigger_is_enabled();
+
+/**
+ * @brief Adds samples to the trigger engine.
+ *
+ * The samples are recorded in the capture buffer. Once the trigger
+ * has fired and the window is complete, it is transmitted. Until
+ * then, further samples are ignored.
+ *
+ * @param samples array of samples (whole frames)
+ * @param num_samples number of samples
+ * @param timestamp time of the first frame (in µs)
+ * @param frame_period time between two frames (in ns)
+ */
+void trigger_add_samples(const uint16_t *samples, int num_samples, uint32_t timestamp, uint32_t frame_period);
+
+/**
+ * @brief Continues transmitting the captured window.
+ *
+ * Adds as many samples to the transmit queue as fit. Once the
+ * window has been completely added, the trigger is re-armed.
+ */
+void trigger_ship();
+
+/// Re-arms the trigger (discarding the recorded samples)
+void trigger_reset();
+
+/**
+ * @brief Gets the number of captured windows.
+ *
+ * @return number of times the trigger has fired
+ */
+uint32_t trigger_get_count();
+
+#endif
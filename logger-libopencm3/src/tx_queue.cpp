@@ -0,0 +1,77 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Transmit queue (packets waiting for transmission)
+ *
+ * The queue is a circular buffer of fixed-size packets.
+ * Packets are added by the DMA interrupt handler and removed
+ * by the USB interrupt handler.
+ */
+
+#include "tx_queue.h"
+
+static constexpr int QUEUE_SIZE = TX_QUEUE_LEN + 1;
+
+struct tx_packet
+{
+    int len;
+    uint8_t data[TX_PACKET_SIZE];
+};
+
+// 0 <= head < QUEUE_SIZE
+// 0 <= tail < QUEUE_SIZE
+// head == tail: queue is empty
+// Therefore, the queue must never be filled completely.
+static volatile int queue_head = 0; // updated when adding packets
+static volatile int queue_tail = 0; // updated when removing packets
+
+static tx_packet packets[QUEUE_SIZE];
+
+static int next_index(int index)
+{
+    index++;
+    return index < QUEUE_SIZE ? index : 0;
+}
+
+uint8_t *tx_queue_alloc()
+{
+    int head = queue_head;
+    if (next_index(head) == queue_tail)
+        return nullptr;
+
+    return packets[head].data;
+}
+
+void tx_queue_commit(int len)
+{
+    int head = queue_head;
+    packets[head].len = len;
+    queue_head = next_index(head);
+}
+
+const uint8_t *tx_queue_peek(int *len)
+{
+    int tail = queue_tail;
+    if (tail == queue_head)
+        return nullptr;
+
+    *len = packets[tail].len;
+    return packets[tail].data;
+}
+
+void tx_queue_remove()
+{
+    int tail = queue_tail;
+    if (tail != queue_head)
+        queue_tail = next_index(tail);
+}
+
+void tx_queue_reset()
+{
+    queue_head = 0;
+    queue_tail = 0;
+}
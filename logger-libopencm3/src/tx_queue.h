@@ -0,0 +1,52 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Transmit queue (packets waiting for transmission)
+ */
+
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include <stdint.h>
+
+// Maximum size of a packet (in bytes)
+#define TX_PACKET_SIZE 64
+
+// Number of packets that fit into the queue
+#define TX_QUEUE_LEN 32
+
+/**
+ * @brief Gets the buffer for the next packet to be added.
+ *
+ * The packet is not added to the queue until `tx_queue_commit()` is called.
+ *
+ * @return buffer of size `TX_PACKET_SIZE`, or `nullptr` if the queue is full
+ */
+uint8_t *tx_queue_alloc();
+
+/**
+ * @brief Adds the packet returned by `tx_queue_alloc()` to the queue.
+ *
+ * @param len packet length (in bytes)
+ */
+void tx_queue_commit(int len);
+
+/**
+ * @brief Gets the oldest packet in the queue without removing it.
+ *
+ * @param len variable receiving the packet length
+ * @return packet data, or `nullptr` if the queue is empty
+ */
+const uint8_t *tx_queue_peek(int *len);
+
+/// Removes the oldest packet from the queue
+void tx_queue_remove();
+
+/// Resets (empties) the queue
+void tx_queue_reset();
+
+#endif
@@ -10,13 +10,14 @@
 
 #include "usb_descriptor.h"
 #include <algorithm>
+#include <string.h>
 
-static usbd_request_return_codes msft_string_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
+static usbd_request_return_codes string_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
 static usbd_request_return_codes msft_feature_desc(usbd_device *usbd_dev, usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
 
 #define USB_VID 0xcafe        // Vendor ID
 #define USB_PID 0xbabe        // Product ID
-#define USB_DEVICE_REL 0x0051 // release 0.5.1
+#define USB_DEVICE_REL 0x0053 // release 0.5.3
 
 const char *const usb_desc_strings[4] = {
     "Tutorial",          //  USB Manufacturer
@@ -44,6 +45,62 @@ static const struct usb_endpoint_descriptor comm_endpoint_desc[] = {
         .extra = nullptr,
         .extralen = 0,
     },
+    {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP_EVENT_IN,
+        .bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
+        .wMaxPacketSize = INTR_MAX_PACKET_SIZE,
+        .bInterval = 1, // every frame
+        .extra = nullptr,
+        .extralen = 0,
+    },
+};
+
+static const struct usb_endpoint_descriptor iso_low_endpoint_desc[] = {
+    {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP_DATA_IN,
+        .bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+        .wMaxPacketSize = ISO_PACKET_SIZE(ALTSETTING_ISO_LOW),
+        .bInterval = 1, // every frame
+        .extra = nullptr,
+        .extralen = 0,
+    },
+    {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP_EVENT_IN,
+        .bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
+        .wMaxPacketSize = INTR_MAX_PACKET_SIZE,
+        .bInterval = 1, // every frame
+        .extra = nullptr,
+        .extralen = 0,
+    },
+};
+
+static const struct usb_endpoint_descriptor iso_high_endpoint_desc[] = {
+    {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP_DATA_IN,
+        .bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+        .wMaxPacketSize = ISO_PACKET_SIZE(ALTSETTING_ISO_HIGH),
+        .bInterval = 1, // every frame
+        .extra = nullptr,
+        .extralen = 0,
+    },
+    {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP_EVENT_IN,
+        .bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
+        .wMaxPacketSize = INTR_MAX_PACKET_SIZE,
+        .bInterval = 1, // every frame
+        .extra = nullptr,
+        .extralen = 0,
+    },
 };
 
 static const struct usb_interface_descriptor comm_if_desc[] = {
@@ -51,7 +108,7 @@ static const struct usb_interface_descriptor comm_if_desc[] = {
         .bLength = USB_DT_INTERFACE_SIZE,
         .bDescriptorType = USB_DT_INTERFACE,
         .bInterfaceNumber = INTF_COMM,
-        .bAlternateSetting = 0,
+        .bAlternateSetting = ALTSETTING_BULK,
         .bNumEndpoints = sizeof(comm_endpoint_desc) / sizeof(comm_endpoint_desc[0]),
         .bInterfaceClass = USB_CLASS_VENDOR,
         .bInterfaceSubClass = 0,
@@ -61,12 +118,43 @@ static const struct usb_interface_descriptor comm_if_desc[] = {
         .extra = nullptr,
         .extralen = 0,
     },
+    {
+        .bLength = USB_DT_INTERFACE_SIZE,
+        .bDescriptorType = USB_DT_INTERFACE,
+        .bInterfaceNumber = INTF_COMM,
+        .bAlternateSetting = ALTSETTING_ISO_LOW,
+        .bNumEndpoints = sizeof(iso_low_endpoint_desc) / sizeof(iso_low_endpoint_desc[0]),
+        .bInterfaceClass = USB_CLASS_VENDOR,
+        .bInterfaceSubClass = 0,
+        .bInterfaceProtocol = 0, // vendor specific
+        .iInterface = USB_STRINGS_DATA_IF_ID,
+        .endpoint = iso_low_endpoint_desc,
+        .extra = nullptr,
+        .extralen = 0,
+    },
+    {
+        .bLength = USB_DT_INTERFACE_SIZE,
+        .bDescriptorType = USB_DT_INTERFACE,
+        .bInterfaceNumber = INTF_COMM,
+        .bAlternateSetting = ALTSETTING_ISO_HIGH,
+        .bNumEndpoints = sizeof(iso_high_endpoint_desc) / sizeof(iso_high_endpoint_desc[0]),
+        .bInterfaceClass = USB_CLASS_VENDOR,
+        .bInterfaceSubClass = 0,
+        .bInterfaceProtocol = 0, // vendor specific
+        .iInterface = USB_STRINGS_DATA_IF_ID,
+        .endpoint = iso_high_endpoint_desc,
+        .extra = nullptr,
+        .extralen = 0,
+    },
 };
 
+// selected alternate setting (maintained by LibOpenCM3)
+static uint8_t comm_altsetting = ALTSETTING_BULK;
+
 static const struct usb_interface usb_interfaces[] = {
     {
-        .cur_altsetting = nullptr,
-        .num_altsetting = 1,
+        .cur_altsetting = &comm_altsetting,
+        .num_altsetting = sizeof(comm_if_desc) / sizeof(comm_if_desc[0]),
         .iface_assoc = nullptr,
         .altsetting = comm_if_desc,
     },
@@ -103,15 +191,56 @@ const struct usb_device_descriptor usb_device_desc = {
     .bNumConfigurations = sizeof(usb_config_desc) / sizeof(usb_config_desc[0]),
 };
 
+// String descriptors in UTF-16LE format (index 0: language ID),
+// built once at startup so they can be served without conversion
+static constexpr int NUM_STRINGS = sizeof(usb_desc_strings) / sizeof(usb_desc_strings[0]);
+static uint8_t string_desc_buf[160] __attribute__((aligned(2)));
+static const uint8_t *string_descs[1 + NUM_STRINGS];
+
+// Language ID descriptor: English (United States)
+static const uint8_t lang_id_desc[] = {4, USB_DT_STRING, 0x09, 0x04};
+
+void usb_init_string_descs()
+{
+    string_descs[0] = lang_id_desc;
+
+    uint8_t *p = string_desc_buf;
+    for (int i = 0; i < NUM_STRINGS; i++)
+    {
+        const char *str = usb_desc_strings[i];
+        int len = strlen(str);
+        int desc_len = 2 + 2 * len;
+        if (desc_len > 255 || p + desc_len > string_desc_buf + sizeof(string_desc_buf))
+            break; // remaining strings are served by LibOpenCM3
+
+        string_descs[i + 1] = p;
+        *p++ = desc_len;
+        *p++ = USB_DT_STRING;
+        for (int j = 0; j < len; j++)
+        {
+            *p++ = str[j];
+            *p++ = 0;
+        }
+    }
+}
+
+const uint8_t *usb_get_string_desc(int index)
+{
+    if (index < 0 || index > NUM_STRINGS)
+        return nullptr;
+    return string_descs[index];
+}
+
 // ---- Windows Compatible ID (WCID) / Automatic driver installation ----
 
 // Registers additional control request handlers to implement
+// the WCID descriptors and serve the precomputed string descriptors
 // See https://github.com/pbatard/libwdi/wiki/WCID-Devices
 void register_wcid_desc(usbd_device *usb_dev)
 {
     usbd_register_control_callback(usb_dev,
                                    USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE, USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
-                                   msft_string_desc);
+                                   string_desc);
     usbd_register_control_callback(usb_dev,
                                    USB_REQ_TYPE_VENDOR, USB_REQ_TYPE_TYPE,
                                    msft_feature_desc);
@@ -143,7 +272,7 @@ static const uint8_t wcid_feature_desc[] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00              // reserved 6 bytes
 };
 
-usbd_request_return_codes msft_string_desc(__attribute__((unused)) usbd_device *usbd_dev, usb_setup_data *req,
+usbd_request_return_codes string_desc(__attribute__((unused)) usbd_device *usbd_dev, usb_setup_data *req,
                                            uint8_t **buf, uint16_t *len,
                                            __attribute__((unused)) usbd_control_complete_callback *complete)
 {
@@ -156,6 +285,19 @@ usbd_request_return_codes msft_string_desc(__attribute__((unused)) usbd_device *
         return USBD_REQ_HANDLED;
     }
 
+    // other string descriptors: serve precomputed UTF-16 descriptor
+    // instead of having LibOpenCM3 convert the string on each request
+    if (req->bRequest == USB_REQ_GET_DESCRIPTOR && (req->wValue >> 8) == USB_DT_STRING)
+    {
+        const uint8_t *desc = usb_get_string_desc(req->wValue & 0xff);
+        if (desc == nullptr)
+            return USBD_REQ_NEXT_CALLBACK;
+
+        *buf = const_cast<uint8_t *>(desc);
+        *len = std::min(*len, (uint16_t)desc[0]);
+        return USBD_REQ_HANDLED;
+    }
+
     return USBD_REQ_NEXT_CALLBACK;
 }
 
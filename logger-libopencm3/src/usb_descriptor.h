@@ -16,12 +16,46 @@
 #define INTR_MAX_PACKET_SIZE 16
 #define BULK_MAX_PACKET_SIZE 64
 
+// Size of an isochronous packet containing up to n data packets,
+// each prefixed with its length (1 byte)
+#define ISO_PACKET_SIZE(n) ((n) * (1 + BULK_MAX_PACKET_SIZE))
+// Maximum number of data packets per isochronous packet (limited by packet memory)
+#define ISO_MAX_PACKETS_PER_FRAME 2
+
 // Endpoint number for data transmission from device to host
 #define EP_DATA_IN 0x81
+// Endpoint number for event transmission from device to host (interrupt endpoint)
+#define EP_EVENT_IN 0x82
 
 // Interface index
 #define INTF_COMM 0
 
+// Alternate settings of the interface (isochronous settings: number of data packets per frame)
+#define ALTSETTING_BULK 0     // bulk endpoint (no guaranteed bandwidth)
+#define ALTSETTING_ISO_LOW 1  // isochronous endpoint, 1 data packet per frame
+#define ALTSETTING_ISO_HIGH 2 // isochronous endpoint, 2 data packets per frame
+
+// Vendor request for setting/getting the sample rate
+#define SAMPLE_RATE_ID 0x40
+// Vendor request for getting the counters (samples, dropped samples, triggers)
+#define COUNTERS_ID 0x41
+// Vendor request for setting/getting the sample format
+#define FORMAT_ID 0x42
+// Vendor request for setting/getting the sampled channels
+#define CHANNELS_ID 0x43
+// Vendor request for setting/getting the sampling mode
+#define MODE_ID 0x44
+// Vendor request for setting/getting the decimation ratio
+#define DECIMATION_ID 0x45
+// Vendor request for setting/getting the trigger configuration
+#define TRIGGER_ID 0x46
+// Vendor request for setting/getting the flush timeout (packet fill policy)
+#define FLUSH_TIMEOUT_ID 0x47
+// Vendor request for getting the active configuration
+#define CONFIG_ID 0x48
+// Vendor request for setting/getting the alarm configuration
+#define ALARM_ID 0x49
+
 // USB descriptor string table
 extern const char *const usb_desc_strings[4];
 // USB device descriptor
@@ -29,6 +63,13 @@ extern const struct usb_device_descriptor usb_device_desc;
 // USB device configurations
 extern const struct usb_config_descriptor usb_config_desc[];
 
+// Builds the string descriptor table
+void usb_init_string_descs();
+
+// Returns the precomputed string descriptor with the given index
+// (or nullptr if it is not available)
+const uint8_t *usb_get_string_desc(int index);
+
 // Register control request handlers for Microsoft WCID descriptors
 void register_wcid_desc(usbd_device *usb_dev);
 
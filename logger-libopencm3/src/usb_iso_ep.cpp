@@ -0,0 +1,96 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Isochronous IN endpoint (double-buffered)
+ *
+ * Isochronous endpoints always use both buffer descriptors of the
+ * endpoint for transmission (buffer 0: ADDR_TX/COUNT_TX, buffer 1:
+ * ADDR_RX/COUNT_RX). DTOG_TX selects the buffer the peripheral
+ * transmits in the next frame; the application writes to the other one.
+ * DTOG_TX toggles after each transaction. There is no handshake and
+ * thus no retransmission.
+ */
+
+#include "usb_iso_ep.h"
+#include <libopencm3/stm32/st_usbfs.h>
+
+// Size of the packet memory (in bytes)
+static constexpr uint16_t PMA_SIZE = 512;
+
+// Offsets of the fields in the buffer descriptor table entry
+static constexpr int BTABLE_ADDR_TX = 0;
+static constexpr int BTABLE_COUNT_TX = 2;
+static constexpr int BTABLE_ADDR_RX = 4;
+static constexpr int BTABLE_COUNT_RX = 6;
+
+// packet buffer allocated by LibOpenCM3 (restored when switching back to bulk mode)
+static uint16_t bulk_addr[8];
+
+// Returns pointer to a field of the buffer descriptor table
+static volatile uint32_t *btable_field(uint8_t ep, int field)
+{
+    return (volatile uint32_t *)(USB_PMA_BASE + (*USB_BTABLE_REG + (ep & 0x07) * 8 + field) * 2);
+}
+
+// Sets the endpoint type and the TX status, and resets DTOG_TX.
+// CTR bits are written as 1 so they are not accidentally cleared.
+static void ep_reg_set_tx(uint8_t ep, uint16_t type, uint16_t tx_stat)
+{
+    uint16_t val = *USB_EP_REG(ep);
+    uint16_t toggle = (val & USB_EP_TX_DTOG) | ((val & USB_EP_TX_STAT) ^ tx_stat);
+    *USB_EP_REG(ep) = (val & USB_EP_NTOGGLE_MSK & ~USB_EP_TYPE) | type | toggle | USB_EP_RX_CTR | USB_EP_TX_CTR;
+}
+
+void usb_iso_ep_setup(uint8_t ep, uint16_t max_size)
+{
+    ep &= 0x07;
+
+    // Place both buffers at the top of the packet memory
+    // (the buffer addresses must be even)
+    max_size = (max_size + 1) & ~1;
+    bulk_addr[ep] = *btable_field(ep, BTABLE_ADDR_TX);
+    *btable_field(ep, BTABLE_ADDR_TX) = PMA_SIZE - 2 * max_size;
+    *btable_field(ep, BTABLE_COUNT_TX) = 0;
+    *btable_field(ep, BTABLE_ADDR_RX) = PMA_SIZE - max_size;
+    *btable_field(ep, BTABLE_COUNT_RX) = 0;
+
+    // Peripheral starts with buffer 0 (empty packet)
+    ep_reg_set_tx(ep, USB_EP_TYPE_ISO, USB_EP_TX_STAT_VALID);
+}
+
+void usb_iso_ep_reset(uint8_t ep)
+{
+    ep &= 0x07;
+
+    *btable_field(ep, BTABLE_ADDR_TX) = bulk_addr[ep];
+    *btable_field(ep, BTABLE_COUNT_TX) = 0;
+    *btable_field(ep, BTABLE_ADDR_RX) = 0;
+    *btable_field(ep, BTABLE_COUNT_RX) = 0;
+
+    ep_reg_set_tx(ep, USB_EP_TYPE_BULK, USB_EP_TX_STAT_NAK);
+}
+
+void usb_iso_ep_write_packet(uint8_t ep, const uint8_t *buf, int len)
+{
+    ep &= 0x07;
+
+    // write to the buffer not used by the peripheral
+    bool is_buf1 = (*USB_EP_REG(ep) & USB_EP_TX_DTOG) == 0;
+    uint16_t addr = *btable_field(ep, is_buf1 ? BTABLE_ADDR_RX : BTABLE_ADDR_TX);
+
+    // packet memory is organized as 16-bit words with a 32-bit stride
+    volatile uint32_t *dst = (volatile uint32_t *)(USB_PMA_BASE + addr * 2);
+    for (int i = 0; i < len / 2; i++)
+    {
+        *dst++ = buf[0] | (buf[1] << 8);
+        buf += 2;
+    }
+    if (len & 1)
+        *dst = *buf;
+
+    *btable_field(ep, is_buf1 ? BTABLE_COUNT_RX : BTABLE_COUNT_TX) = len;
+}
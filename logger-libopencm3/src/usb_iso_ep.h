@@ -0,0 +1,55 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Isochronous IN endpoint (double-buffered)
+ */
+
+#ifndef USB_ISO_EP_H
+#define USB_ISO_EP_H
+
+#include <stdint.h>
+
+/**
+ * @brief Switches a bulk IN endpoint to isochronous mode.
+ *
+ * LibOpenCM3 does not support double-buffered isochronous endpoints.
+ * This function must be called after `usbd_ep_setup()` has set up the
+ * endpoint as a bulk endpoint. It places both packet buffers at the top
+ * of the packet memory, which must not be used by any other endpoint.
+ *
+ * Thereafter, packets must be written with `usb_iso_ep_write_packet()`.
+ *
+ * @param ep endpoint address
+ * @param max_size maximum packet size
+ */
+void usb_iso_ep_setup(uint8_t ep, uint16_t max_size);
+
+/**
+ * @brief Switches an endpoint set up with `usb_iso_ep_setup()` back to bulk mode.
+ *
+ * The endpoint's original packet buffer is restored, the data toggle
+ * is reset and the endpoint NAKs until the next packet is written.
+ *
+ * @param ep endpoint address
+ */
+void usb_iso_ep_reset(uint8_t ep);
+
+/**
+ * @brief Writes the packet to be transmitted in the next frame.
+ *
+ * The packet is written to the buffer not used by the USB peripheral.
+ * It should be called once the previous packet has been transmitted
+ * (endpoint callback). If no packet is written, the buffer is
+ * transmitted again with its previous content.
+ *
+ * @param ep endpoint address
+ * @param buf packet data
+ * @param len packet length (0 for an empty packet)
+ */
+void usb_iso_ep_write_packet(uint8_t ep, const uint8_t *buf, int len);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Benchmark helpers for native tests
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Returns the CPU cycle counter (time stamp counter on x86, nanoseconds elsewhere)
+static inline uint64_t bench_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+// Unit of `bench_cycles()`
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_CYCLE_UNIT "cycles"
+#else
+#define BENCH_CYCLE_UNIT "ns"
+#endif
+
+#endif
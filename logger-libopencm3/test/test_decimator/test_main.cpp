@@ -0,0 +1,161 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Native tests and benchmark of the decimation filter
+ *
+ * Run with: pio test -e native -f test_decimator
+ */
+
+#include "../bench.h"
+#include "decimator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unity.h>
+
+static constexpr int NUM_FRAMES = 4096;
+static constexpr int MAX_SAMPLES = NUM_FRAMES * DECIMATOR_MAX_CHANNELS;
+
+static uint16_t input[MAX_SAMPLES];
+static uint16_t output[MAX_SAMPLES];
+static uint16_t expected[MAX_SAMPLES];
+
+// Fills the input with random 12-bit values (every channel with a different offset)
+static void fill_input(int num_channels, int noise)
+{
+    srand(1);
+    for (int i = 0; i < NUM_FRAMES * num_channels; i++)
+    {
+        int ch = i % num_channels;
+        int value = 500 * ch + rand() % (noise + 1);
+        input[i] = value > 4095 ? 4095 : value;
+    }
+}
+
+// Reference: average of each block of `ratio` frames, scaled to 16 bits, rounded half up
+static int reference(int num_channels, int log2_ratio)
+{
+    int ratio = 1 << log2_ratio;
+    int num_out = NUM_FRAMES / ratio;
+    for (int f = 0; f < num_out; f++)
+    {
+        for (int ch = 0; ch < num_channels; ch++)
+        {
+            uint64_t sum = 0;
+            for (int i = 0; i < ratio; i++)
+                sum += input[(f * ratio + i) * num_channels + ch];
+            expected[f * num_channels + ch] = (sum * 16 * 2 + ratio) / (2 * ratio);
+        }
+    }
+    return num_out;
+}
+
+// Decimates the input in chunks of the given size (in frames)
+static int decimate(int num_channels, int log2_ratio, int chunk)
+{
+    decimator dec;
+    decimator_init(&dec, num_channels, log2_ratio);
+    int num_out = 0;
+    for (int f = 0; f < NUM_FRAMES; f += chunk)
+    {
+        int n = chunk < NUM_FRAMES - f ? chunk : NUM_FRAMES - f;
+        int max_out = n / (1 << log2_ratio) + 1;
+        int m = decimator_process(&dec, input + f * num_channels, n, output + num_out * num_channels);
+        TEST_ASSERT_TRUE_MESSAGE(m <= max_out, "more output frames than documented");
+        num_out += m;
+    }
+    return num_out;
+}
+
+static void assert_ratios(int num_channels, int noise)
+{
+    fill_input(num_channels, noise);
+    for (int log2_ratio = 0; log2_ratio <= DECIMATOR_MAX_LOG2_RATIO; log2_ratio++)
+    {
+        int num_expected = reference(num_channels, log2_ratio);
+
+        // in one go, and in chunks not aligned to the ratio (partial sums carried over)
+        static const int chunks[] = {NUM_FRAMES, 1, 7, 100};
+        for (int chunk : chunks)
+        {
+            char msg[80];
+            snprintf(msg, sizeof(msg), "channels %d, ratio %d, chunk %d", num_channels, 1 << log2_ratio, chunk);
+            int num_out = decimate(num_channels, log2_ratio, chunk);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(num_expected, num_out, msg);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY_MESSAGE(expected, output, num_out * num_channels, msg);
+        }
+    }
+}
+
+void test_single_channel()
+{
+    assert_ratios(1, 4095);
+}
+
+void test_interleaved_channels()
+{
+    // channels have different offsets so mixed up channels are detected
+    assert_ratios(3, 200);
+    assert_ratios(DECIMATOR_MAX_CHANNELS, 200);
+}
+
+void test_full_scale()
+{
+    // maximum input must not overflow at any ratio
+    for (int i = 0; i < MAX_SAMPLES; i++)
+        input[i] = 4095;
+    for (int log2_ratio = 0; log2_ratio <= DECIMATOR_MAX_LOG2_RATIO; log2_ratio++)
+    {
+        int num_out = decimate(DECIMATOR_MAX_CHANNELS, log2_ratio, NUM_FRAMES);
+        for (int i = 0; i < num_out * DECIMATOR_MAX_CHANNELS; i++)
+            TEST_ASSERT_EQUAL_UINT16(4095 * 16, output[i]);
+    }
+}
+
+void test_benchmark()
+{
+    static const int channel_counts[] = {1, 4, DECIMATOR_MAX_CHANNELS};
+    static const int log2_ratios[] = {0, 4, DECIMATOR_MAX_LOG2_RATIO};
+
+    fill_input(DECIMATOR_MAX_CHANNELS, 4095);
+    for (int num_channels : channel_counts)
+    {
+        for (int log2_ratio : log2_ratios)
+        {
+            constexpr int REPEAT = 200;
+            decimator dec;
+            decimator_init(&dec, num_channels, log2_ratio);
+            int num_frames = MAX_SAMPLES / num_channels;
+            uint64_t start = bench_cycles();
+            for (int r = 0; r < REPEAT; r++)
+                decimator_process(&dec, input, num_frames, output);
+            uint64_t cycles = bench_cycles() - start;
+
+            char msg[80];
+            snprintf(msg, sizeof(msg), "channels %d, ratio %3d: %.2f " BENCH_CYCLE_UNIT "/input sample",
+                     num_channels, 1 << log2_ratio, (double)cycles / ((double)REPEAT * num_frames * num_channels));
+            TEST_MESSAGE(msg);
+        }
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_channel);
+    RUN_TEST(test_interleaved_channels);
+    RUN_TEST(test_full_scale);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+/*
+ * USB Tutorial
+ *
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Native tests and benchmark of the sample encoder (delta format)
+ *
+ * Run with: pio test -e native -f test_encoder
+ */
+
+#include "../bench.h"
+#include "encoder.h"
+#include "tx_queue.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+static constexpr int MAX_SAMPLES = 200000;
+
+static uint16_t input[MAX_SAMPLES];
+static uint16_t decoded[MAX_SAMPLES];
+static int num_decoded;
+static int num_payload_bytes;
+
+// Reads bits (LSB first) from a byte array
+struct bit_reader
+{
+    const uint8_t *data;
+    int len;
+    int pos; // bit position
+
+    uint32_t get(int n)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < n; i++, pos++)
+        {
+            TEST_ASSERT_LESS_THAN_INT_MESSAGE(len * 8, pos, "bit stream too short");
+            value |= (uint32_t)((data[pos >> 3] >> (pos & 7)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+// Reference decoder for a delta format packet
+static void decode_packet(const uint8_t *packet, int len)
+{
+    const packet_header *header = reinterpret_cast<const packet_header *>(packet);
+    TEST_ASSERT_EQUAL_UINT8(FORMAT_DELTA_RICE, header->format & ~(FORMAT_FLAG_16BIT | FORMAT_FLAG_WINDOW_START));
+
+    int num_channels = __builtin_popcount(header->channels);
+    const uint8_t *payload = packet + sizeof(packet_header);
+    int k = payload[0];
+    uint16_t prev[ENCODER_MAX_CHANNELS];
+    for (int ch = 0; ch < num_channels; ch++)
+    {
+        prev[ch] = payload[1 + 2 * ch] | (payload[2 + 2 * ch] << 8);
+        decoded[num_decoded++] = prev[ch];
+    }
+
+    int prefix_size = 1 + 2 * num_channels;
+    bit_reader reader = {payload + prefix_size, len - (int)sizeof(packet_header) - prefix_size, 0};
+    for (int i = num_channels; i < header->num_samples; i++)
+    {
+        uint32_t q = 0;
+        while (q < RICE_ESCAPE && reader.get(1) == 1)
+            q++;
+        uint32_t zz = q == RICE_ESCAPE ? reader.get(RICE_ESCAPE_BITS) : (q << k) | reader.get(k);
+        int ch = i % num_channels;
+        prev[ch] += (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+        decoded[num_decoded++] = prev[ch];
+    }
+
+    num_payload_bytes += len - sizeof(packet_header);
+}
+
+// Removes all packets from the transmit queue (and decodes them if requested)
+static void drain_queue(bool decode)
+{
+    int len;
+    const uint8_t *packet;
+    while ((packet = tx_queue_peek(&len)) != nullptr)
+    {
+        if (decode)
+            decode_packet(packet, len);
+        else
+            num_payload_bytes += len - sizeof(packet_header);
+        tx_queue_remove();
+    }
+}
+
+// Encodes the input samples in chunks (and decodes the resulting packets if requested)
+static void encode(uint8_t channel_mask, int num_samples, bool decode = true)
+{
+    tx_queue_reset();
+    encoder_reset();
+    encoder_set_format(FORMAT_DELTA_RICE);
+    encoder_set_channels(channel_mask);
+    num_decoded = 0;
+    num_payload_bytes = 0;
+
+    int num_channels = __builtin_popcount(channel_mask);
+    int chunk = 64 * num_channels;
+    for (int offset = 0; offset < num_samples;)
+    {
+        int n = chunk < num_samples - offset ? chunk : num_samples - offset;
+        int not_added = encoder_add_samples(input + offset, n, 0, 1000);
+        offset += n - not_added;
+        drain_queue(decode);
+    }
+    encoder_flush();
+    drain_queue(decode);
+}
+
+// Fills the input with a noisy sine wave (slowly varying signal)
+static void fill_sine(int num_samples, int num_channels, int noise)
+{
+    srand(1);
+    for (int i = 0; i < num_samples; i++)
+    {
+        int frame = i / num_channels;
+        int ch = i % num_channels;
+        int value = 2048 + (int)(1800 * sin(frame * 0.002 * (ch + 1))) + rand() % (2 * noise + 1) - noise;
+        input[i] = value < 0 ? 0 : value > 4095 ? 4095 : value;
+    }
+}
+
+// Fills the input with white noise (full range of the given number of bits)
+static void fill_noise(int num_samples, int num_bits)
+{
+    srand(2);
+    for (int i = 0; i < num_samples; i++)
+        input[i] = rand() & ((1 << num_bits) - 1);
+}
+
+static void assert_round_trip(uint8_t channel_mask, int num_samples)
+{
+    encode(channel_mask, num_samples);
+    TEST_ASSERT_EQUAL_INT(num_samples, num_decoded);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(input, decoded, num_samples);
+}
+
+void test_round_trip_sine()
+{
+    static const uint8_t masks[] = {0x01, 0x05, 0x70, 0xff};
+    for (uint8_t mask : masks)
+    {
+        int num_channels = __builtin_popcount(mask);
+        fill_sine(20000 * num_channels, num_channels, 8);
+        assert_round_trip(mask, 20000 * num_channels);
+    }
+}
+
+void test_round_trip_noise()
+{
+    // 12-bit noise forces escaped values, 16-bit noise the full escape range
+    fill_noise(20000, 12);
+    assert_round_trip(0x01, 20000);
+    fill_noise(24000, 16);
+    assert_round_trip(0x0f, 24000);
+}
+
+void test_round_trip_steps()
+{
+    // alternating flat sections and jumps (Rice parameter has to adapt in both directions)
+    for (int i = 0; i < 30000; i++)
+        input[i] = (i / 500) % 2 == 0 ? 100 + (i & 1) : 4000 - (i % 7);
+    assert_round_trip(0x01, 30000);
+}
+
+// Encodes the input and reports compression ratio and encoder cycles per sample
+static void benchmark(const char *name, uint8_t channel_mask, int num_samples)
+{
+    uint64_t start = bench_cycles();
+    encode(channel_mask, num_samples, false);
+    uint64_t cycles = bench_cycles() - start;
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%-12s compression %.2fx vs raw 16-bit, %.1f " BENCH_CYCLE_UNIT "/sample",
+             name, num_samples * 2.0 / num_payload_bytes, (double)cycles / num_samples);
+    TEST_MESSAGE(msg);
+}
+
+void test_benchmark()
+{
+    fill_sine(MAX_SAMPLES, 1, 8);
+    benchmark("noisy sine", 0x01, MAX_SAMPLES);
+    fill_sine(MAX_SAMPLES, 4, 8);
+    benchmark("4 channels", 0x0f, MAX_SAMPLES);
+    fill_noise(MAX_SAMPLES, 12);
+    benchmark("white noise", 0x01, MAX_SAMPLES);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_sine);
+    RUN_TEST(test_round_trip_noise);
+    RUN_TEST(test_round_trip_steps);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -66,7 +66,7 @@ message *message::get_message(uint8_t *buf, int buf_len)
     if (msg->magic != MESSAGE_MAGIC)
         return nullptr;
 
-    if (msg->len > buf_len)
+    if (msg->len < MESSAGE_MIN_LEN || msg->len > buf_len)
         return nullptr;
 
     uint8_t crc = calculate_crc8(buf, msg->len - 1);
@@ -88,3 +88,138 @@ void message::remove_invalid_message(uint8_t* buf, int& buf_len)
     buf_len = buf + buf_len - static_cast<uint8_t*>(p);
     memmove(buf, p, buf_len);
 }
+
+
+const message* message_view::contiguous() const
+{
+    if (len2 != 0)
+        return nullptr;
+    return reinterpret_cast<const message*>(part1);
+}
+
+
+int message_view::copy_to(uint8_t* buf, int max_len) const
+{
+    int n1 = len1 < max_len ? len1 : max_len;
+    memcpy(buf, part1, n1);
+    int n2 = len2 < max_len - n1 ? len2 : max_len - n1;
+    if (n2 > 0)
+        memcpy(buf + n1, part2, n2);
+    return n1 + n2;
+}
+
+
+message_parser::message_parser(const uint8_t* ring, int ring_size)
+    : ring(ring), ring_size(ring_size)
+{
+    reset();
+}
+
+
+void message_parser::reset(int head)
+{
+    start = head;
+    pos = head;
+    state = wait_magic;
+}
+
+
+bool message_parser::parse(int head, message_view& msg)
+{
+    while (state != complete && pos != head) {
+        // end of the contiguous part of the new bytes
+        int end = head > pos ? head : ring_size;
+
+        switch (state) {
+        case wait_magic: {
+            const void* p = memchr(ring + pos, MESSAGE_MAGIC, end - pos);
+            if (p == nullptr) {
+                pos = end < ring_size ? end : 0;
+                start = pos;
+                continue;
+            }
+            pos = static_cast<const uint8_t*>(p) - ring;
+            start = pos;
+            crc = crc8_tab[MESSAGE_MAGIC];
+            num_bytes = 1;
+            state = wait_len;
+            break;
+        }
+
+        case wait_len: {
+            uint8_t b = ring[pos];
+            // a message must fit into the ring buffer (with one byte kept free)
+            if (b < MESSAGE_MIN_LEN || b >= ring_size) {
+                resync();
+                continue;
+            }
+            msg_len = b;
+            crc = crc8_tab[b ^ crc];
+            num_bytes = 2;
+            state = wait_body;
+            break;
+        }
+
+        default: { // wait_body
+            // update CRC with the available bytes up to the CRC byte
+            int n = msg_len - 1 - num_bytes;
+            if (n > end - pos)
+                n = end - pos;
+            for (int i = 0; i < n; i++)
+                crc = crc8_tab[ring[pos + i] ^ crc];
+            num_bytes += n;
+            pos += n;
+            if (pos == ring_size)
+                pos = 0;
+            if (num_bytes < msg_len - 1 || pos == head)
+                continue;
+
+            // CRC byte
+            if (ring[pos] != crc) {
+                resync();
+                continue;
+            }
+            num_bytes++;
+            state = complete;
+            break;
+        }
+        }
+
+        pos = next(pos);
+    }
+
+    if (state != complete)
+        return false;
+
+    int len1 = ring_size - start;
+    msg.part1 = ring + start;
+    if (len1 >= msg_len) {
+        msg.len1 = msg_len;
+        msg.part2 = nullptr;
+        msg.len2 = 0;
+    } else {
+        msg.len1 = len1;
+        msg.part2 = ring;
+        msg.len2 = msg_len - len1;
+    }
+    return true;
+}
+
+
+void message_parser::release()
+{
+    if (state != complete)
+        return;
+
+    start = pos;
+    state = wait_magic;
+}
+
+
+void message_parser::resync()
+{
+    // continue searching after the magic byte of the invalid message
+    start = next(start);
+    pos = start;
+    state = wait_magic;
+}
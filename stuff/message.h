@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 #define MESSAGE_MAGIC 0xd3
+#define MESSAGE_MIN_LEN 5 // magic, length, type, subtype, CRC8
 
 
 struct message
@@ -53,5 +54,113 @@ struct message
 
 } __attribute__((packed));
 
+
+/**
+ * @brief View of a message in a ring buffer.
+ * 
+ * The message is not copied. It might wrap around the end of the
+ * ring buffer and is then split into two parts.
+ */
+struct message_view
+{
+    const uint8_t* part1; // first part (starting with the magic byte)
+    int len1; // length of first part
+    const uint8_t* part2; // second part (at the start of the ring buffer), or `nullptr`
+    int len2; // length of second part
+
+    /// Returns the message length (incl. CRC8)
+    int len() const { return len1 + len2; }
+
+    /// Returns the byte at the given index of the message
+    uint8_t operator[](int index) const { return index < len1 ? part1[index] : part2[index - len1]; }
+
+    uint8_t type() const { return (*this)[2]; }
+    uint8_t subtype() const { return (*this)[3]; }
+
+    /**
+     * @brief Returns a pointer to the message if it is contiguous.
+     * 
+     * @return message, or `nullptr` if the message wraps around
+     */
+    const message* contiguous() const;
+
+    /**
+     * @brief Copies the message into the buffer.
+     * 
+     * @param buf buffer to copy to
+     * @param max_len maximum number of bytes to copy
+     * @return number of copied bytes
+     */
+    int copy_to(uint8_t* buf, int max_len) const;
+};
+
+
+/**
+ * @brief Incremental message parser reading from a ring buffer.
+ * 
+ * The parser is the reader of the ring buffer (it owns the tail).
+ * Bytes are inspected once as they arrive, the CRC8 is calculated
+ * on the fly, and messages are returned as views into the ring
+ * buffer. The writer must not overwrite the bytes starting at `tail()`.
+ * 
+ * If a message turns out to be invalid, the parser resynchronizes at
+ * the byte after the invalid message's magic byte. So each byte is
+ * inspected at most `255` times, independent of the ring buffer size.
+ * Length bytes of `ring_size` or more are invalid as such messages
+ * could never be received completely.
+ */
+class message_parser
+{
+public:
+    /**
+     * @brief Creates a new parser.
+     * 
+     * @param ring ring buffer
+     * @param ring_size size of the ring buffer (in bytes)
+     */
+    message_parser(const uint8_t* ring, int ring_size);
+
+    /**
+     * @brief Parses the bytes added to the ring buffer.
+     * 
+     * If a valid message is found, it remains available (and occupies
+     * the ring buffer) until `release()` is called.
+     * 
+     * @param head index of the end of the valid data (exclusive)
+     * @param msg view receiving the message
+     * @return `true` if a valid message has been found
+     */
+    bool parse(int head, message_view& msg);
+
+    /// Releases the message returned by `parse()`
+    void release();
+
+    /// Returns the index of the first byte still in use
+    int tail() const { return start; }
+
+    /// Resets the parser (empties the ring buffer)
+    void reset(int head = 0);
+
+private:
+    enum parser_state : uint8_t {
+        wait_magic,
+        wait_len,
+        wait_body,
+        complete
+    };
+
+    const uint8_t* ring;
+    int ring_size;
+    int start; // index of the start of the current message (magic byte)
+    int pos; // index of the next byte to inspect
+    int msg_len; // length of the current message
+    int num_bytes; // number of bytes of the current message inspected so far
+    uint8_t crc; // CRC8 of the current message inspected so far
+    parser_state state;
+
+    int next(int index) const { return index + 1 < ring_size ? index + 1 : 0; }
+    void resync();
+};
+
 #endif
 
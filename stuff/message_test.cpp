@@ -0,0 +1,269 @@
+/*
+ * USB Tutorial
+ * 
+ * Copyright (c) 2020 Manuel Bleichenbacher
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ * 
+ * Native fuzz test and benchmark of the message parser
+ * 
+ * Build and run: g++ -O2 -o message_test message_test.cpp message.cpp && ./message_test
+ * 
+ * Random streams of valid messages and garbage (with many magic bytes)
+ * are fed into a small ring buffer in chunks of random size. The
+ * messages found by the parser are compared against a reference
+ * scanner working on the entire stream.
+ */
+
+#include "message.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef std::vector<uint8_t> bytes;
+
+static std::mt19937 rng(1);
+
+static int random_int(int min, int max)
+{
+    return std::uniform_int_distribution<int>(min, max)(rng);
+}
+
+// Checks the message at the start of the data (with the existing linear buffer function)
+static bool is_valid(const uint8_t* data, int len)
+{
+    uint8_t buf[256] = { 0 };
+    memcpy(buf, data, len);
+    return message::get_message(buf, len < 8 ? 8 : len) != nullptr;
+}
+
+// Appends a valid message of the given length
+static void append_message(bytes& stream, int len)
+{
+    uint8_t msg[256];
+    msg[0] = MESSAGE_MAGIC;
+    msg[1] = len;
+    for (int i = 2; i < len - 1; i++)
+        msg[i] = random_int(0, 255);
+    for (int crc = 0; crc < 256; crc++) {
+        msg[len - 1] = crc;
+        if (is_valid(msg, len))
+            break;
+    }
+    stream.insert(stream.end(), msg, msg + len);
+}
+
+// Creates a stream of messages and garbage (garbage is biased towards magic bytes and large length bytes)
+static bytes create_stream(int num_messages, int max_len, int garbage_per_message)
+{
+    bytes stream;
+    for (int i = 0; i < num_messages; i++) {
+        int n = random_int(0, 2 * garbage_per_message);
+        for (int j = 0; j < n; j++) {
+            int r = random_int(0, 7);
+            stream.push_back(r == 0 ? MESSAGE_MAGIC : r == 1 ? random_int(200, 255) : random_int(0, 255));
+        }
+        append_message(stream, random_int(MESSAGE_MIN_LEN, max_len));
+    }
+    // padding so that candidates at the end are resolved (the parser cannot know the stream has ended)
+    stream.insert(stream.end(), 256, 0);
+    return stream;
+}
+
+// Reference scanner: finds all valid messages (as start offset and length) in the entire stream
+static std::vector<std::pair<int, int>> reference_scan(const bytes& stream, int ring_size)
+{
+    std::vector<std::pair<int, int>> found;
+    int n = stream.size();
+    int i = 0;
+    while (i < n) {
+        if (stream[i] == MESSAGE_MAGIC && i + 1 < n) {
+            int len = stream[i + 1];
+            if (len >= MESSAGE_MIN_LEN && len < ring_size && i + len <= n && is_valid(&stream[i], len)) {
+                found.push_back(std::make_pair(i, len));
+                i += len;
+                continue;
+            }
+        }
+        i++;
+    }
+    return found;
+}
+
+// Feeds the stream into the ring buffer in random chunks. Returns the number of messages found or -1 on failure.
+static int fuzz(const bytes& stream, int ring_size)
+{
+    std::vector<std::pair<int, int>> expected = reference_scan(stream, ring_size);
+    std::vector<uint8_t> ring(ring_size);
+    message_parser parser(ring.data(), ring_size);
+    int head = 0;
+    size_t pos = 0;
+    size_t num_found = 0;
+    int num_wrapped = 0;
+
+    while (true) {
+        // add a chunk of random size (limited by the free space)
+        int free_space = (parser.tail() - head - 1 + ring_size) % ring_size;
+        int n = random_int(1, 64);
+        if (n > free_space)
+            n = free_space;
+        if (n > (int)(stream.size() - pos))
+            n = stream.size() - pos;
+        for (int i = 0; i < n; i++) {
+            ring[head] = stream[pos++];
+            head = head + 1 < ring_size ? head + 1 : 0;
+        }
+
+        message_view msg;
+        bool has_progress = n > 0;
+        while (parser.parse(head, msg)) {
+            has_progress = true;
+            if (num_found >= expected.size()) {
+                printf("FAIL: unexpected message\n");
+                return -1;
+            }
+            const std::pair<int, int>& exp = expected[num_found];
+            uint8_t copy[256];
+            int len = msg.copy_to(copy, sizeof(copy));
+            if (len != exp.second || memcmp(copy, &stream[exp.first], len) != 0 || msg.type() != copy[2]) {
+                printf("FAIL: message %d differs from reference\n", (int)num_found);
+                return -1;
+            }
+            const message* contiguous = msg.contiguous();
+            if (msg.part2 != nullptr) {
+                num_wrapped++;
+            } else if (contiguous == nullptr || contiguous->len != len) {
+                printf("FAIL: contiguous view\n");
+                return -1;
+            }
+            num_found++;
+            parser.release();
+        }
+
+        if (pos == stream.size() && !has_progress)
+            break;
+        if (!has_progress) {
+            printf("FAIL: parser stalled with full ring buffer\n");
+            return -1;
+        }
+    }
+
+    if (num_found != expected.size()) {
+        printf("FAIL: found %d of %d messages\n", (int)num_found, (int)expected.size());
+        return -1;
+    }
+    if (num_wrapped == 0) {
+        printf("FAIL: no wrapped messages tested\n");
+        return -1;
+    }
+    return num_found;
+}
+
+// Parses the stream with the ring buffer parser (adding as much data as fits). Returns the number of messages.
+template <int N>
+static int parse_ring(const bytes& stream)
+{
+    static uint8_t ring[N];
+    message_parser parser(ring, sizeof(ring));
+    int head = 0;
+    int num_found = 0;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        int free_space = (parser.tail() - head - 1 + (int)sizeof(ring)) % (int)sizeof(ring);
+        int n = free_space;
+        if (n > (int)(stream.size() - pos))
+            n = stream.size() - pos;
+        // copy in up to two parts (as circ_buf::add_data does)
+        int n1 = n < (int)sizeof(ring) - head ? n : sizeof(ring) - head;
+        memcpy(ring + head, &stream[pos], n1);
+        memcpy(ring, &stream[pos + n1], n - n1);
+        pos += n;
+        head = (head + n) % sizeof(ring);
+
+        message_view msg;
+        while (parser.parse(head, msg)) {
+            num_found++;
+            parser.release();
+        }
+    }
+    return num_found;
+}
+
+// Parses the stream with the linear buffer functions (memchr and memmove, adding as much data as fits).
+// Returns the number of messages.
+template <int N>
+static int parse_linear(const bytes& stream)
+{
+    static uint8_t buf[N];
+    int buf_len = 0;
+    int num_found = 0;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        int n = sizeof(buf) - buf_len;
+        if (n > (int)(stream.size() - pos))
+            n = stream.size() - pos;
+        memcpy(buf + buf_len, &stream[pos], n);
+        pos += n;
+        buf_len += n;
+
+        while (buf_len > 0) {
+            message* msg = message::get_message(buf, buf_len);
+            if (msg != nullptr) {
+                num_found++;
+                int len = msg->len;
+                buf_len -= len;
+                memmove(buf, buf + len, buf_len);
+            } else if (buf[0] != MESSAGE_MAGIC || (buf_len >= 2 && buf[1] < MESSAGE_MIN_LEN)
+                    || (buf_len >= 2 && buf[1] <= buf_len) || buf_len == (int)sizeof(buf)) {
+                message::remove_invalid_message(buf, buf_len);
+            } else {
+                break; // wait for more data
+            }
+        }
+    }
+    return num_found;
+}
+
+template <typename F>
+static void benchmark(const char* name, const bytes& stream, F parse)
+{
+    auto start = std::chrono::steady_clock::now();
+    int num_found = 0;
+    const int repeat = 10;
+    for (int i = 0; i < repeat; i++)
+        num_found = parse(stream);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-28s %8.1f MB/s (%d messages)\n", name, stream.size() * repeat / seconds / 1e6, num_found);
+}
+
+int main()
+{
+    int total = 0;
+    static const int ring_sizes[] = { 64, 200, 300, 1024 };
+    for (int ring_size : ring_sizes) {
+        for (int round = 0; round < 20; round++) {
+            int max_len = ring_size - 1 < 255 ? ring_size - 1 : 255;
+            bytes stream = create_stream(2000, max_len, round % 4 * 20);
+            int n = fuzz(stream, ring_size);
+            if (n < 0) {
+                printf("ring size %d, round %d\n", ring_size, round);
+                return 1;
+            }
+            total += n;
+        }
+    }
+    printf("fuzz test: %d messages OK\n", total);
+
+    static const int garbage_levels[] = { 0, 20, 200 };
+    for (int garbage : garbage_levels) {
+        bytes stream = create_stream(20000, 64, garbage);
+        printf("garbage bytes per message: %d\n", garbage);
+        benchmark("  ring buffer parser, 1 KB", stream, parse_ring<1024>);
+        benchmark("  linear buffer, 1 KB", stream, parse_linear<1024>);
+        benchmark("  ring buffer parser, 16 KB", stream, parse_ring<16384>);
+        benchmark("  linear buffer, 16 KB", stream, parse_linear<16384>);
+    }
+    return 0;
+}